@@ -38,12 +38,18 @@
 #include "drivers/device.h"
 #include "kernel/config.h"
 #include "drivers/drivers.h"
+#include "kernel/atomic.h"
 
 /**@name Device Drivers
  *
  * This module contains functions for initializing device drivers and
  * maintaining a list of found devices.
  *
+ * Devices are only added, by device_init during boot, and never
+ * removed. A device is published by storing it in the table before
+ * incrementing number_of_devices, so device_get can walk the table
+ * without a lock.
+ *
  * @{
  */
 
@@ -51,7 +57,7 @@
 static device_t *device_table[CONFIG_MAX_DEVICES];
 
 /** Number of initialized device drivers. */
-static int number_of_devices = 0;
+static volatile int number_of_devices = 0;
 
 /**
  * Finds a driver for a given type of device.
@@ -91,6 +97,7 @@ void device_init(void)
     int i;
     io_descriptor_t *descriptor;
     drivers_available_t *driver;
+    device_t *dev;
 
     descriptor = (io_descriptor_t*)IO_DESCRIPTOR_AREA;
 
@@ -114,8 +121,11 @@ void device_init(void)
                             descriptor->type, descriptor->io_area_base,
                             driver->name);
                 
-                device_table[number_of_devices]=driver->initfunc(descriptor);
-                if (device_table[number_of_devices] != NULL) {
+                dev = driver->initfunc(descriptor);
+                if (dev != NULL) {
+                    device_table[number_of_devices] = dev;
+                    /* publish the device */
+                    _memory_barrier();
                     number_of_devices++;
                     if (number_of_devices >= CONFIG_MAX_DEVICES)
                         break;
@@ -124,7 +134,6 @@ void device_init(void)
         }
 	descriptor++;
     }
-
 }
 
 /**
@@ -139,9 +148,12 @@ void device_init(void)
  */
 device_t *device_get(uint32_t typecode, uint32_t n)
 {
-    int i;
+    int i, count;
 
-    for(i = 0; i < number_of_devices; i++) {
+    /* devices below the count read here are fully initialized */
+    count = number_of_devices;
+
+    for(i = 0; i < count; i++) {
         if (device_table[i]->type == typecode) {
             if (n == 0)
                 return device_table[i];
@@ -149,6 +161,7 @@ device_t *device_get(uint32_t typecode, uint32_t n)
                 n--;
         }
     }
+
     return NULL;
 }
 
@@ -100,6 +100,7 @@ device_t *disk_init(io_descriptor_t *desc)
     gbd->total_blocks = disk_total_blocks;
 
     spinlock_reset(&real_dev->slock);
+    spinlock_stats_register(&real_dev->slock);
     real_dev->request_queue = NULL;
     real_dev->request_served = NULL;
 
@@ -142,9 +143,13 @@ static void disk_interrupt_handle(device_t *device)
 	
     /* Wake up the function that is waiting this request to be
        handled.  In case of synchronous request that is
-       disk_submit_request. In case of asynchronous call it is
-       some other function.*/
-    semaphore_V(real_dev->request_served->sem);
+       disk_submit_request, waiting on the completion embedded in
+       the request. In case of asynchronous call it is some other
+       function.*/
+    if (real_dev->request_served->sem == NULL)
+	completion_complete((completion_t *)&real_dev->request_served->done);
+    else
+	semaphore_V(real_dev->request_served->sem);
     real_dev->request_served = NULL;
     disk_next_request(device->generic_device);
     
@@ -219,14 +224,12 @@ static int disk_submit_request(gbd_t *gbd, gbd_request_t *request)
 
     sem_null = (request->sem == NULL);
     if(sem_null) {
-	/* Semaphore is null so this is synchronous request.
-	   Create a new semaphore with value 0. This will cause
+	/* Semaphore is null so this is synchronous request. Wait on
+	   the completion embedded in the request. This will cause
 	   this function to block until the interrupt handler has 
 	   handled the request.
 	 */
-	request->sem = semaphore_create(0);
-	if(request->sem == NULL)
-	    return 0;   /* failure */
+	completion_reset(&request->done);
     }
 
     intr_status = _interrupt_disable();
@@ -244,11 +247,8 @@ static int disk_submit_request(gbd_t *gbd, gbd_request_t *request)
 
     if(sem_null) {
 	/* Synchronous call. Wait here until the interrupt handler has
-	   handled the request. After this semaphore created earlier
-	   in this function is no longer needed. */
-	semaphore_P(request->sem);
-	semaphore_destroy(request->sem);
-	request->sem = NULL;
+	   handled the request. */
+	completion_wait(&request->done);
 
 	/* Request is handled. Check the retrun value. */
 	if(request->return_value == 0) 
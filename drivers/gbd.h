@@ -40,6 +40,7 @@
 #include "lib/libc.h"
 #include "drivers/device.h"
 #include "kernel/semaphore.h"
+#include "kernel/completion.h"
 
 /* Operation codes for Generic Block Device requests. */
 
@@ -91,6 +92,10 @@ typedef struct gbd_request_struct {
        the sem is signaled, return value can be read from this field. 
        0 is success, other values indicate failure. */
     int             return_value;
+
+    /* Completion signaled instead of sem for synchronous requests.
+       Used internally by drivers. */
+    completion_t    done;
 } gbd_request_t;
 
 /* Generic block device descriptor. */
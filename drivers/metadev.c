@@ -40,6 +40,7 @@
 #include "kernel/assert.h"
 #include "kernel/kmalloc.h"
 #include "kernel/interrupt.h"
+#include "kernel/ipi.h"
 
 /**@name Metadevices
  *
@@ -173,6 +174,7 @@ device_t *cpustatus_init(io_descriptor_t *desc)
     if (cpu == NULL) 
         KERNEL_PANIC("Could not reserve memory for CPU status device driver.");
     spinlock_reset(&cpu->slock);
+    spinlock_stats_register(&cpu->slock);
 
     dev->real_device = cpu;
 
@@ -222,9 +224,6 @@ void cpustatus_generate_irq(device_t *dev)
     intr_status = _interrupt_disable();
     spinlock_acquire(&cpu->slock);
 
-    /* If you really want to do something with inter-cpu interrupts,
-       do it here.*/
-
     /* Generate the IRQ */
     iobase->command = CPU_COMMAND_RAISE_IRQ;
 
@@ -233,9 +232,9 @@ void cpustatus_generate_irq(device_t *dev)
 }
 
 /**
- * Interrupt handler for the CPU status device. Currently the CPU
- * status device driver only supports ping-ponging interrupts between
- * CPUs.
+ * Interrupt handler for the CPU status device. Clears the interrupt
+ * and processes the inter-processor interrupt mailbox of this CPU
+ * (see kernel/ipi.c).
  *
  * @param device Pointer to the CPU status device
  */
@@ -257,13 +256,14 @@ void cpustatus_interrupt_handle(device_t *dev){
 
     spinlock_acquire(&cpu->slock);
 
-    /* If you really want to do something with inter-cpu interrupts,
-       do it here. */
-
     /* Clear the interrupt */
     iobase->command = CPU_COMMAND_CLEAR_IRQ;
     
     spinlock_release(&cpu->slock);
+
+    /* Messages posted after the interrupt was cleared raise it
+       again, so none are lost. */
+    ipi_handle();
 }
 
 /** 
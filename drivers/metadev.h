@@ -61,12 +61,11 @@ typedef struct {
 /* The real device structure for a CPU status device. Structure of
    this type is stored the real_device field of device_t data
    structure. Currently this only provides synchronization for
-   generating and clearing interrupts. */
+   generating and clearing interrupts. The messages delivered with
+   the interrupts are kept in mailboxes in kernel/ipi.c. */
 typedef struct {
     /* Spinlock to synchronize access to the driver */
     spinlock_t slock;
-    /* If you are using inter-cpu interrupts for something, the
-       necessary data may be added here. */
 } cpu_real_device_t;
 
 device_t *rtc_init(io_descriptor_t *desc);
@@ -45,6 +45,7 @@
 
 /* import assembler function for clock handling */
 extern void _timer_set_ticks(uint32_t ticks);
+extern uint32_t _timer_get_ticks(void);
 
 /**
  * Sets timer interrupt (hw interrupt 5) to fire after ticks.
@@ -62,4 +63,27 @@ void timer_set_ticks(uint32_t ticks)
     _interrupt_set_state(intr_status);
 }
 
+/**
+ * Stops the timer interrupt. The CP0 timer cannot really be turned
+ * off, so a pending timer interrupt is acknowledged and the next one
+ * is pushed as far into the future as the 32-bit counter allows.
+ */
+
+void timer_stop(void)
+{
+    timer_set_ticks(0xffffffff);
+}
+
+/**
+ * Returns the current value of the CP0 cycle counter. The counter
+ * wraps around, so only differences of two values are meaningful.
+ *
+ * @return Number of ticks since an arbitrary point in time.
+ */
+
+uint32_t timer_get_ticks(void)
+{
+    return _timer_get_ticks();
+}
+
 /** @} */
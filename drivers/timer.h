@@ -40,6 +40,8 @@
 #include "lib/types.h"
 
 void timer_set_ticks(uint32_t ticks);
+void timer_stop(void);
+uint32_t timer_get_ticks(void);
 
 #endif /* DRIVERS_POLLTTY_H */
 
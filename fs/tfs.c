@@ -69,6 +69,10 @@ typedef struct {
        one operation at a time in any case) */
     semaphore_t    *lock;
 
+    /* Where the next block allocation starts searching the
+       allocation bitmap (next-fit) */
+    uint32_t       alloc_hint;
+
     /* Buffers for read/write operations on disk. */       
     tfs_inode_t    *buffer_inode;   /* buffer for inode blocks */
     bitmap_t       *buffer_bat;     /* buffer for allocation block */
@@ -76,8 +80,20 @@ typedef struct {
 } tfs_t;
 
 
+/* Frees the memory allocated for a filesystem by tfs_init. Buffers
+   which have not been allocated are NULL. */
+static void tfs_free(fs_t *fs)
+{
+    tfs_t *tfs = (tfs_t *)fs->internal;
+
+    kfree(tfs->buffer_inode);
+    kfree(tfs->buffer_bat);
+    kfree(tfs->buffer_md);
+    kfree(fs);
+}
+
 /** 
- * Initialize trivial filesystem. Allocates 1 page of memory dynamically for
+ * Initialize trivial filesystem. Allocates memory dynamically for
  * filesystem data structure, tfs data structure and buffers needed.
  * Sets fs_t and tfs_t fields. If initialization is succesful, returns
  * pointer to fs_t data structure. Else NULL pointer is returned.
@@ -89,7 +105,6 @@ typedef struct {
  */
 fs_t * tfs_init(gbd_t *disk) 
 {
-    uint32_t addr;
     gbd_request_t req;
     char name[TFS_VOLUMENAME_MAX];
     fs_t *fs;
@@ -106,58 +121,60 @@ fs_t * tfs_init(gbd_t *disk)
 	kprintf("tfs_init: could not create a new semaphore.\n");
 	return NULL;
     }
+    semaphore_set_name(sem, "tfs");
 
-    addr = pagepool_get_phys_page();
-    if(addr == 0) {
+    /* fs_t and tfs_t are allocated together, the block buffers
+       separately. The buffers are read and written by the disk, so
+       they come from kmalloc, which gives unmapped memory. */
+    fs = kmalloc(sizeof(fs_t) + sizeof(tfs_t));
+    if(fs == NULL) {
         semaphore_destroy(sem);
 	kprintf("tfs_init: could not allocate memory.\n");
 	return NULL;
     }
-    addr = ADDR_PHYS_TO_KERNEL(addr);      /* transform to vm address */
-
+    tfs = (tfs_t *)((uint32_t)fs + sizeof(fs_t));
+    fs->internal = (void *)tfs;
 
-    /* Assert that one page is enough */
-    KERNEL_ASSERT(PAGE_SIZE >= (3*TFS_BLOCK_SIZE+sizeof(tfs_t)+sizeof(fs_t)));
+    tfs->buffer_inode = kmalloc(TFS_BLOCK_SIZE);
+    tfs->buffer_bat   = kmalloc(TFS_BLOCK_SIZE);
+    tfs->buffer_md    = kmalloc(TFS_BLOCK_SIZE);
+    if(tfs->buffer_inode == NULL || tfs->buffer_bat == NULL
+       || tfs->buffer_md == NULL) {
+        semaphore_destroy(sem);
+	tfs_free(fs);
+	kprintf("tfs_init: could not allocate memory.\n");
+	return NULL;
+    }
     
     /* Read header block, and make sure this is tfs drive */
     req.block = 0;
     req.sem = NULL;
-    req.buf = ADDR_KERNEL_TO_PHYS(addr);   /* disk needs physical addr */
+    /* disk needs physical addr */
+    req.buf = ADDR_KERNEL_TO_PHYS((uint32_t)tfs->buffer_inode);
     r = disk->read_block(disk, &req);
     if(r == 0) {
         semaphore_destroy(sem);
-	pagepool_free_phys_page(ADDR_KERNEL_TO_PHYS(addr));
+	tfs_free(fs);
 	kprintf("tfs_init: Error during disk read. Initialization failed.\n");
 	return NULL; 
     }
 
-    if(((uint32_t *)addr)[0] != TFS_MAGIC) {
+    if(((uint32_t *)tfs->buffer_inode)[0] != TFS_MAGIC) {
         semaphore_destroy(sem);
-	pagepool_free_phys_page(ADDR_KERNEL_TO_PHYS(addr));
+	tfs_free(fs);
 	return NULL;
     }
 
     /* Copy volume name from header block. */
-    stringcopy(name, (char *)(addr+4), TFS_VOLUMENAME_MAX);
-
-    /* fs_t, tfs_t and all buffers in tfs_t fit in one page, so obtain
-       addresses for each structure and buffer inside the allocated
-       memory page. */
-    fs  = (fs_t *)addr;
-    tfs = (tfs_t *)(addr + sizeof(fs_t));
-    tfs->buffer_inode = (tfs_inode_t *)((uint32_t)tfs + sizeof(tfs_t));
-    tfs->buffer_bat  = (bitmap_t *)((uint32_t)tfs->buffer_inode + 
-				    TFS_BLOCK_SIZE);
-    tfs->buffer_md   = (tfs_direntry_t *)((uint32_t)tfs->buffer_bat + 
-					TFS_BLOCK_SIZE);
+    stringcopy(name, (char *)tfs->buffer_inode + 4, TFS_VOLUMENAME_MAX);
 
     tfs->totalblocks = MIN(disk->total_blocks(disk), 8*TFS_BLOCK_SIZE);
     tfs->disk        = disk;
+    tfs->alloc_hint  = 0;
 
     /* save the semaphore to the tfs_t */
     tfs->lock = sem;
 
-    fs->internal = (void *)tfs;
     stringcopy(fs->volume_name, name, VFS_NAME_LENGTH);
 
     fs->unmount = tfs_unmount;
@@ -194,7 +211,7 @@ int tfs_unmount(fs_t *fs)
 
     /* free semaphore and allocated memory */
     semaphore_destroy(tfs->lock);
-    pagepool_free_phys_page(ADDR_KERNEL_TO_PHYS((uint32_t)fs));
+    tfs_free(fs);
     return VFS_OK;
 }
 
@@ -261,11 +278,35 @@ int tfs_close(fs_t *fs, int fileid)
 }
 
 
+/**
+ * Allocates a free block from the allocation bitmap in
+ * tfs->buffer_bat. The search continues from where the previous
+ * allocation ended, so the used blocks at the beginning of the disk
+ * are not rescanned on every allocation. The caller must hold
+ * tfs->lock and have read the allocation block into the buffer.
+ *
+ * @param tfs The filesystem.
+ *
+ * @return Number of the allocated block, -1 if the disk is full.
+ */
+static uint32_t tfs_alloc_block(tfs_t *tfs)
+{
+    int block;
+
+    block = bitmap_findnset_from(tfs->buffer_bat, tfs->totalblocks,
+                                 tfs->alloc_hint);
+    if (block >= 0)
+        tfs->alloc_hint = block + 1;
+
+    return (uint32_t)block;
+}
+
 /**
  * Creates file of given size. Implements fs.create(). Checks that
  * file name doesn't allready exist in directory block.Allocates
  * enough blocks from the allocation block for the file (1 for inode
- * and then enough for the file of given size). Reserved blocks are zeroed.
+ * and then enough for the file of given size), in one contiguous run
+ * if there is one. Reserved blocks are zeroed.
  *
  * @param fs Pointer to fs data structure of the device.
  * @param filename File name of the file to be created
@@ -281,6 +322,7 @@ int tfs_create(fs_t *fs, char *filename, int size)
     uint32_t i;
     uint32_t numblocks = (size + TFS_BLOCK_SIZE - 1)/TFS_BLOCK_SIZE; 
     int index = -1;
+    int start;
     int r;
 
     semaphore_P(tfs->lock);
@@ -334,9 +376,20 @@ int tfs_create(fs_t *fs, char *filename, int size)
     }
 
 
+    /* ...look for a run of free blocks for the inode and the file,
+       so that the file can be read sequentially... */
+    start = bitmap_find_range(tfs->buffer_bat, tfs->totalblocks,
+                              numblocks + 1);
+    if(start >= 0) {
+	bitmap_set_range(tfs->buffer_bat, start, numblocks + 1, 1);
+	tfs->alloc_hint = start + numblocks + 1;
+    }
+
     /* ...find space for inode... */
-    tfs->buffer_md[index].inode = bitmap_findnset(tfs->buffer_bat,
-						  tfs->totalblocks);
+    if(start >= 0)
+	tfs->buffer_md[index].inode = start;
+    else
+	tfs->buffer_md[index].inode = tfs_alloc_block(tfs);
     if((int)tfs->buffer_md[index].inode == -1) {
 	semaphore_V(tfs->lock);
 	return VFS_ERROR;
@@ -346,8 +399,10 @@ int tfs_create(fs_t *fs, char *filename, int size)
        inode.*/
     tfs->buffer_inode->filesize = size;
     for(i=0; i<numblocks; i++) {
-	tfs->buffer_inode->block[i] = bitmap_findnset(tfs->buffer_bat,
-						      tfs->totalblocks);
+	if(start >= 0)
+	    tfs->buffer_inode->block[i] = start + 1 + i;
+	else
+	    tfs->buffer_inode->block[i] = tfs_alloc_block(tfs);
 	if((int)tfs->buffer_inode->block[i] == -1) {
 	    /* Disk full. No free block found. */
 	    semaphore_V(tfs->lock);
@@ -794,7 +849,6 @@ int tfs_getfree(fs_t *fs)
     tfs_t *tfs = (tfs_t *)fs->internal;
     gbd_request_t req;
     int allocated = 0;
-    uint32_t i;
     int r;
 
     semaphore_P(tfs->lock);
@@ -809,9 +863,7 @@ int tfs_getfree(fs_t *fs)
 	return VFS_ERROR;
     }
 
-    for(i=0;i<tfs->totalblocks;i++) {
-	allocated += bitmap_get(tfs->buffer_bat,i);
-    }
+    allocated = bitmap_count(tfs->buffer_bat, tfs->totalblocks);
     
     semaphore_V(tfs->lock);
     return (tfs->totalblocks - allocated)*TFS_BLOCK_SIZE;
@@ -36,6 +36,8 @@
 
 #include "fs/vfs.h"
 #include "kernel/semaphore.h"
+#include "kernel/completion.h"
+#include "kernel/rcu.h"
 #include "kernel/assert.h"
 #include "kernel/config.h"
 #include "lib/libc.h"
@@ -48,6 +50,14 @@
  *  This module implements one virtual filesystem in which all actual
  *  filesystems are mounted so that they behave like one big filesystem.
  *
+ *  The table of mounted filesystems is read without locking, using
+ *  read-copy-update (see kernel/rcu.c). A lookup takes a reference
+ *  to the mount entry it finds, which keeps the filesystem mounted
+ *  until the operation is done. Unmounting unpublishes the entry,
+ *  waits for a grace period so that no lookup can take new
+ *  references, and then waits for the existing references to be
+ *  dropped before unmounting the filesystem.
+ *
  *  @{
  */
 
@@ -58,6 +68,14 @@ typedef struct {
 
     /* Name of the mountpoint. */
     char mountpoint[VFS_NAME_LENGTH];
+
+    /* Number of references: one held by the mount table while the
+       entry is published, one by each operation using the
+       filesystem. */
+    volatile int refs;
+
+    /* Completed when the last reference is dropped. */
+    completion_t unused;
 } vfs_entry_t;
 
 /* Open file information */
@@ -75,11 +93,17 @@ typedef struct {
 
 /* Table of mounted filesystems. */
 static struct {
-    /* Binary semaphore for locking this table. */
+    /* Binary semaphore serializing mounting and unmounting.
+       Lookups do not take it. */
     semaphore_t *sem;
 
-    /* Table of mounted filesystems. */
-    vfs_entry_t filesystems[CONFIG_MAX_FILESYSTEMS];
+    /* Table of mounted filesystems. A row points to the entry of
+       the same index while a filesystem is mounted on it and is
+       NULL otherwise. Published with rcu_assign_pointer. */
+    vfs_entry_t *filesystems[CONFIG_MAX_FILESYSTEMS];
+
+    /* Storage for the entries. */
+    vfs_entry_t entries[CONFIG_MAX_FILESYSTEMS];
 } vfs_table;
 
 
@@ -126,10 +150,13 @@ void vfs_init(void)
     openfile_table.sem = semaphore_create(1);
 
     KERNEL_ASSERT(vfs_table.sem != NULL && openfile_table.sem != NULL);
+    semaphore_set_name(vfs_table.sem, "vfs_table");
+    semaphore_set_name(openfile_table.sem, "openfile_table");
 
     /* Clear table of mounted filesystems. */
     for(i=0; i<CONFIG_MAX_FILESYSTEMS; i++) {
-	vfs_table.filesystems[i].filesystem = NULL;
+	vfs_table.filesystems[i] = NULL;
+	vfs_table.entries[i].filesystem = NULL;
     }
 
     /* Clear table of open files. */
@@ -139,6 +166,7 @@ void vfs_init(void)
 
     vfs_op_sem = semaphore_create(1);
     vfs_unmount_sem = semaphore_create(0);
+    semaphore_set_name(vfs_op_sem, "vfs_op");
 
     vfs_ops = 0;
     vfs_usable = 1;
@@ -173,16 +201,19 @@ void vfs_deinit(void)
         kprintf("VFS: Continuing forceful unmount.\n");
     }
 
+    /* No operations are running and no new ones can start, so no
+       one can hold references to the mount entries. */
     semaphore_P(vfs_table.sem);
     semaphore_P(openfile_table.sem);
     
     for (row = 0; row < CONFIG_MAX_FILESYSTEMS; row++) {
-        fs = vfs_table.filesystems[row].filesystem;
-        if (fs != NULL) {
+        if (vfs_table.filesystems[row] != NULL) {
+            fs = vfs_table.entries[row].filesystem;
             kprintf("VFS: Forcefully unmounting volume [%s]\n", 
-                    vfs_table.filesystems[row].mountpoint);
+                    vfs_table.entries[row].mountpoint);
+            vfs_table.filesystems[row] = NULL;
             fs->unmount(fs);
-            vfs_table.filesystems[row].filesystem = NULL;
+            vfs_table.entries[row].filesystem = NULL;
         }
     }
 
@@ -274,29 +305,50 @@ void vfs_mount_all(void)
 }
 
 /**
- * Get pointer to mounted filesystem based on mountpoint name. Note
- * that mount table must be locked before this function is called to be
- * sure that the returned information is valid.
+ * Get the mount entry of a mounted filesystem based on mountpoint
+ * name. The mount table is read without locking. A reference to the
+ * entry is taken, which keeps the filesystem mounted until it is
+ * dropped with vfs_put_filesystem.
  *
  * @param mountpoint Name of mountpoint
  *
- * @return Pointer to filesystem, NULL if filesystem is not mounted.
+ * @return Mount entry, NULL if filesystem is not mounted.
  *
  */
 
-static fs_t *vfs_get_filesystem(char *mountpoint)
+static vfs_entry_t *vfs_get_filesystem(char *mountpoint)
 {
+    interrupt_status_t intr_status;
+    vfs_entry_t *entry;
     int row;
 
+    intr_status = rcu_read_lock();
+
     for (row = 0; row < CONFIG_MAX_FILESYSTEMS; row++) {
-	if(!stringcmp(vfs_table.filesystems[row].mountpoint, mountpoint)) {
-            return vfs_table.filesystems[row].filesystem;
+	entry = vfs_table.filesystems[row];
+	if(entry != NULL && !stringcmp(entry->mountpoint, mountpoint)) {
+	    _atomic_add(&entry->refs, 1);
+	    rcu_read_unlock(intr_status);
+            return entry;
 	}
     }
 
+    rcu_read_unlock(intr_status);
     return NULL;
 }
 
+/**
+ * Drops a reference to a mount entry taken by vfs_get_filesystem.
+ *
+ * @param entry The mount entry
+ */
+
+static void vfs_put_filesystem(vfs_entry_t *entry)
+{
+    if (_atomic_add(&entry->refs, -1) == 1)
+	completion_complete(&entry->unused);
+}
+
 /**
  * Parse pathname into volume (mountpoint) and filename parts.
  *
@@ -416,6 +468,7 @@ static void vfs_end_op()
 
 int vfs_mount(fs_t *fs, char *name)
 {
+    vfs_entry_t *entry;
     int i;
     int row;
 
@@ -427,7 +480,7 @@ int vfs_mount(fs_t *fs, char *name)
     semaphore_P(vfs_table.sem);
     
     for (i = 0; i < CONFIG_MAX_FILESYSTEMS; i++) {
-	if (vfs_table.filesystems[i].filesystem == NULL)
+	if (vfs_table.filesystems[i] == NULL)
 	    break;
     }
 
@@ -441,7 +494,8 @@ int vfs_mount(fs_t *fs, char *name)
     }
 
     for (i = 0; i < CONFIG_MAX_FILESYSTEMS; i++) {
-	if(stringcmp(vfs_table.filesystems[i].mountpoint, name) == 0) {
+	if(vfs_table.filesystems[i] != NULL
+	   && stringcmp(vfs_table.filesystems[i]->mountpoint, name) == 0) {
 	    semaphore_V(vfs_table.sem);
 	    kprintf("VFS: Warning, attempt to mount 2 filesystems "
 		    "with same name\n");
@@ -450,8 +504,12 @@ int vfs_mount(fs_t *fs, char *name)
 	}
     }
 
-    stringcopy(vfs_table.filesystems[row].mountpoint, name, VFS_NAME_LENGTH);
-    vfs_table.filesystems[row].filesystem = fs;
+    entry = &vfs_table.entries[row];
+    stringcopy(entry->mountpoint, name, VFS_NAME_LENGTH);
+    entry->filesystem = fs;
+    entry->refs = 1;
+    completion_reset(&entry->unused);
+    rcu_assign_pointer(vfs_table.filesystems[row], entry);
 
     semaphore_V(vfs_table.sem);
     vfs_end_op();
@@ -473,7 +531,8 @@ int vfs_mount(fs_t *fs, char *name)
 int vfs_unmount(char *name)
 {
     int i, row;
-    fs_t *fs = NULL;
+    vfs_entry_t *entry = NULL;
+    fs_t *fs;
 
     if (vfs_start_op() != VFS_OK)
         return VFS_UNUSABLE;
@@ -481,18 +540,23 @@ int vfs_unmount(char *name)
     semaphore_P(vfs_table.sem);
     
     for (row = 0; row < CONFIG_MAX_FILESYSTEMS; row++) {
-	if(!stringcmp(vfs_table.filesystems[row].mountpoint, name)) {
-	    fs = vfs_table.filesystems[row].filesystem;
+	if(vfs_table.filesystems[row] != NULL
+	   && !stringcmp(vfs_table.filesystems[row]->mountpoint, name)) {
+	    entry = vfs_table.filesystems[row];
 	    break;
 	}
     }
 
-    if(fs == NULL) {
+    if(entry == NULL) {
 	semaphore_V(vfs_table.sem);
         vfs_end_op();
 	return VFS_NOT_FOUND;
     }
+    fs = entry->filesystem;
     
+    /* Unpublish the entry while holding the open file table, so that
+       vfs_open either has opened its file before this check or sees
+       the entry unpublished. */
     semaphore_P(openfile_table.sem);
     for(i = 0; i < CONFIG_MAX_OPEN_FILES; i++) {
 	if(openfile_table.files[i].filesystem == fs) {
@@ -502,11 +566,19 @@ int vfs_unmount(char *name)
 	    return VFS_IN_USE;
 	}
     }
+    rcu_assign_pointer(vfs_table.filesystems[row], NULL);
+    semaphore_V(openfile_table.sem);
+
+    /* After the grace period no lookup can take new references. Drop
+       the reference of the mount table and wait for the operations
+       still using the filesystem. */
+    rcu_synchronize();
+    vfs_put_filesystem(entry);
+    completion_wait(&entry->unused);
 
     fs->unmount(fs);
-    vfs_table.filesystems[row].filesystem = NULL;
+    entry->filesystem = NULL;
     
-    semaphore_V(openfile_table.sem);
     semaphore_V(vfs_table.sem);
     vfs_end_op();
     return VFS_OK;
@@ -529,6 +601,7 @@ openfile_t vfs_open(char *pathname)
     int fileid;
     char volumename[VFS_NAME_LENGTH];
     char filename[VFS_NAME_LENGTH];
+    vfs_entry_t *entry;
     fs_t *fs = NULL;
 
     if (vfs_start_op() != VFS_OK)
@@ -539,7 +612,14 @@ openfile_t vfs_open(char *pathname)
 	return VFS_ERROR;
     }
 
-    semaphore_P(vfs_table.sem);
+    entry = vfs_get_filesystem(volumename);
+
+    if(entry == NULL) {
+        vfs_end_op();
+	return VFS_NO_SUCH_FS;
+    }
+    fs = entry->filesystem;
+
     semaphore_P(openfile_table.sem);
     
     for(file=0; file<CONFIG_MAX_OPEN_FILES; file++) {
@@ -550,17 +630,17 @@ openfile_t vfs_open(char *pathname)
 
     if(file >= CONFIG_MAX_OPEN_FILES) {
 	semaphore_V(openfile_table.sem);
-	semaphore_V(vfs_table.sem);
+	vfs_put_filesystem(entry);
 	kprintf("VFS: Warning, maximum number of open files exceeded.");
         vfs_end_op();
 	return VFS_LIMIT;
     }
 
-    fs = vfs_get_filesystem(volumename);
-
-    if(fs == NULL) {
+    /* An unmount in progress unpublishes the entry before giving up
+       the open file table. */
+    if(vfs_table.filesystems[entry - vfs_table.entries] != entry) {
 	semaphore_V(openfile_table.sem);
-	semaphore_V(vfs_table.sem);
+	vfs_put_filesystem(entry);
         vfs_end_op();
 	return VFS_NO_SUCH_FS;
     }
@@ -568,7 +648,9 @@ openfile_t vfs_open(char *pathname)
     openfile_table.files[file].filesystem = fs;
 
     semaphore_V(openfile_table.sem);
-    semaphore_V(vfs_table.sem);
+
+    /* the open file now keeps the filesystem mounted */
+    vfs_put_filesystem(entry);
 
     fileid = fs->open(fs, filename);
 
@@ -777,6 +859,7 @@ int vfs_create(char *pathname, int size)
 {
     char volumename[VFS_NAME_LENGTH];
     char filename[VFS_NAME_LENGTH];
+    vfs_entry_t *entry;
     fs_t *fs = NULL;
     int ret;
     
@@ -790,19 +873,17 @@ int vfs_create(char *pathname, int size)
         return VFS_ERROR;
     }
 
-    semaphore_P(vfs_table.sem);
-
-    fs = vfs_get_filesystem(volumename);
+    entry = vfs_get_filesystem(volumename);
 
-    if(fs == NULL) {
-	semaphore_V(vfs_table.sem);
+    if(entry == NULL) {
         vfs_end_op();
 	return VFS_NO_SUCH_FS;
     }
 
+    fs = entry->filesystem;
     ret = fs->create(fs, filename, size);
     
-    semaphore_V(vfs_table.sem);
+    vfs_put_filesystem(entry);
 
     vfs_end_op();
     return ret;
@@ -822,6 +903,7 @@ int vfs_remove(char *pathname)
 {
     char volumename[VFS_NAME_LENGTH];
     char filename[VFS_NAME_LENGTH];
+    vfs_entry_t *entry;
     fs_t *fs = NULL;
     int ret;
 
@@ -833,19 +915,17 @@ int vfs_remove(char *pathname)
         return VFS_ERROR;
     }
 
-    semaphore_P(vfs_table.sem);
+    entry = vfs_get_filesystem(volumename);
 
-    fs = vfs_get_filesystem(volumename);
-
-    if(fs == NULL) {
-	semaphore_V(vfs_table.sem);
+    if(entry == NULL) {
         vfs_end_op();
 	return VFS_NO_SUCH_FS;
     }
 
+    fs = entry->filesystem;
     ret = fs->remove(fs, filename);
     
-    semaphore_V(vfs_table.sem);
+    vfs_put_filesystem(entry);
 
     vfs_end_op();
     return ret;
@@ -864,25 +944,24 @@ int vfs_remove(char *pathname)
 
 int vfs_getfree(char *filesystem)
 {
+    vfs_entry_t *entry;
     fs_t *fs = NULL;
     int ret;
     
     if (vfs_start_op() != VFS_OK)
         return VFS_UNUSABLE;
 
-    semaphore_P(vfs_table.sem);
-
-    fs = vfs_get_filesystem(filesystem);
+    entry = vfs_get_filesystem(filesystem);
 
-    if(fs == NULL) {
-	semaphore_V(vfs_table.sem);
+    if(entry == NULL) {
         vfs_end_op();
 	return VFS_NO_SUCH_FS;
     }
 
+    fs = entry->filesystem;
     ret = fs->getfree(fs);
     
-    semaphore_V(vfs_table.sem);
+    vfs_put_filesystem(entry);
     
     vfs_end_op();
     return ret;
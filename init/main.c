@@ -42,19 +42,27 @@
 #include "drivers/yams.h"
 #include "fs/vfs.h"
 #include "kernel/assert.h"
+#include "kernel/bench.h"
 #include "kernel/config.h"
 #include "kernel/halt.h"
 #include "kernel/idle.h"
 #include "kernel/interrupt.h"
+#include "kernel/ipi.h"
 #include "kernel/kmalloc.h"
+#include "kernel/lockprof.h"
 #include "kernel/panic.h"
+#include "kernel/rcu.h"
 #include "kernel/scheduler.h"
 #include "kernel/synch.h"
 #include "kernel/thread.h"
+#include "kernel/timeout.h"
+#include "kernel/trace.h"
 #include "lib/debug.h"
 #include "lib/libc.h"
 #include "net/network.h"
+#include "proc/futex.h"
 #include "proc/process.h"
+#include "vm/pagepool.h"
 #include "vm/vm.h"
 
 /**
@@ -120,6 +128,11 @@ void init_startup_thread(uint32_t arg)
     arg = arg;
     process_id_t pid;
 
+    pagepool_start_zeroer();
+
+    kprintf("Testing inter-processor interrupts\n");
+    ipi_selftest();
+
     kprintf("Mounting filesystems\n");
     vfs_mount_all();
 
@@ -199,18 +212,43 @@ void init(void)
     kwrite("Initializing threading system\n");
     thread_table_init();
 
+    kwrite("Initializing scheduler tracing\n");
+    trace_init();
+
     kwrite("Initializing user process system\n");
     process_init();
 
     kwrite("Initializing sleep queue\n");
     sleepq_init();
 
+#if CONFIG_LOCK_PROFILE
+    kwrite("Initializing lock profiler\n");
+    lockprof_init();
+#endif
+
+    kwrite("Initializing read-copy-update\n");
+    rcu_init();
+
     kwrite("Initializing semaphores\n");
     semaphore_init();
 
+    kwrite("Initializing futexes\n");
+    futex_init();
+
+#if CONFIG_BENCH
+    kwrite("Initializing benchmarks\n");
+    bench_init();
+#endif
+
     kwrite("Initializing device drivers\n");
     device_init();
 
+    kwrite("Initializing timeouts\n");
+    timeout_init();
+
+    kwrite("Initializing inter-processor interrupts\n");
+    ipi_init(numcpus);
+
     kprintf("Initializing virtual filesystem\n");
     vfs_init();
 
@@ -0,0 +1,393 @@
+/*
+ * Kernel synchronization benchmarks.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "kernel/config.h"
+
+#if CONFIG_BENCH
+
+#include "kernel/bench.h"
+#include "kernel/semaphore.h"
+#include "kernel/lock_cond.h"
+#include "kernel/thread.h"
+#include "kernel/spinlock.h"
+#include "kernel/interrupt.h"
+#include "drivers/timer.h"
+#include "lib/libc.h"
+
+/** @name Benchmarks
+ *
+ * Microbenchmarks for the kernel synchronization primitives. Userland
+ * has no threads, so the benchmarks run in kernel threads started on
+ * behalf of a userland program (see tests/sembench.c,
+ * tests/lockbench.c and tests/condbench.c). Only one benchmark runs
+ * at a time. The benchmarks are built only with CONFIG_BENCH.
+ *
+ * Elapsed time is measured with the CP0 Count register of the CPU
+ * the calling thread happens to run on, which assumes that the
+ * counters of all CPUs run in step (they do in YAMS).
+ *
+ * @{
+ */
+
+/* Arguments of one benchmark thread pair */
+typedef struct {
+    semaphore_t *ping;
+    semaphore_t *pong;
+    int rounds;
+} bench_pair_t;
+
+static bench_pair_t bench_pairs[BENCH_MAX_THREADS];
+
+/* Raised by each benchmark thread when it finishes */
+static semaphore_t *bench_done;
+
+/* The lock, the data it protects and the iteration count of the
+   lock benchmark */
+static lock_t bench_lock;
+static volatile uint32_t bench_counter;
+static int bench_lock_rounds;
+
+/* Number of produced but not yet consumed items of the condition
+   variable benchmark and the conditions signalled when the number
+   becomes nonzero and zero, used with bench_lock */
+static int bench_items;
+static cond_t bench_nonempty;
+static cond_t bench_empty;
+
+/* Length of the critical section of the lock benchmark (loop
+   iterations) */
+#define BENCH_LOCK_WORK 20
+
+/* Set while a benchmark is running, protected by bench_slock */
+static int bench_busy;
+static spinlock_t bench_slock;
+
+/**
+ * Initializes the benchmark module.
+ */
+void bench_init(void)
+{
+    spinlock_reset(&bench_slock);
+    spinlock_stats_register(&bench_slock);
+    bench_busy = 0;
+}
+
+/* First thread of a ping-pong pair */
+static void bench_ping(uint32_t arg)
+{
+    bench_pair_t *pair = (bench_pair_t *)arg;
+    int i;
+
+    for (i = 0; i < pair->rounds; i++) {
+	semaphore_V(pair->ping);
+	semaphore_P(pair->pong);
+    }
+    semaphore_V(bench_done);
+}
+
+/* Second thread of a ping-pong pair */
+static void bench_pong(uint32_t arg)
+{
+    bench_pair_t *pair = (bench_pair_t *)arg;
+    int i;
+
+    for (i = 0; i < pair->rounds; i++) {
+	semaphore_P(pair->ping);
+	semaphore_V(pair->pong);
+    }
+    semaphore_V(bench_done);
+}
+
+/**
+ * Runs the semaphore ping-pong benchmark. Every pair of threads
+ * passes the turn back and forth through two semaphores, so each
+ * round is two sleeps and two wakeups. The pairs run concurrently,
+ * contending for the scheduler, sleep queue and thread table locks.
+ *
+ * @param pairs Number of thread pairs
+ * @param rounds Number of round trips per pair
+ *
+ * @return Elapsed cycles, 0 if out of threads or semaphores.
+ */
+static uint32_t bench_sem_pingpong(int pairs, int rounds)
+{
+    TID_t threads[2 * BENCH_MAX_THREADS];
+    uint32_t start, elapsed;
+    int i, created = 0, failed = 0;
+
+    for (i = 0; i < pairs; i++) {
+	bench_pairs[i].ping = semaphore_create(0);
+	bench_pairs[i].pong = semaphore_create(0);
+	bench_pairs[i].rounds = rounds;
+	if (bench_pairs[i].ping == NULL || bench_pairs[i].pong == NULL)
+	    failed = 1;
+    }
+
+    for (i = 0; i < pairs && !failed; i++) {
+	threads[created] = thread_create(&bench_ping, 
+					 (uint32_t)&bench_pairs[i]);
+	if (threads[created] < 0)
+	    break;
+	created++;
+	threads[created] = thread_create(&bench_pong, 
+					 (uint32_t)&bench_pairs[i]);
+	if (threads[created] < 0)
+	    break;
+	created++;
+    }
+
+    /* If anything could not be created, let the threads that were
+       finish at once. */
+    if (created < 2 * pairs) {
+	failed = 1;
+	for (i = 0; i < pairs; i++)
+	    bench_pairs[i].rounds = 0;
+    }
+
+    start = timer_get_ticks();
+    for (i = 0; i < created; i++)
+	thread_run(threads[i]);
+    for (i = 0; i < created; i++)
+	semaphore_P(bench_done);
+    elapsed = timer_get_ticks() - start;
+
+    for (i = 0; i < pairs; i++) {
+	if (bench_pairs[i].ping != NULL)
+	    semaphore_destroy(bench_pairs[i].ping);
+	if (bench_pairs[i].pong != NULL)
+	    semaphore_destroy(bench_pairs[i].pong);
+    }
+
+    return failed ? 0 : elapsed;
+}
+
+/* A thread of the lock benchmark */
+static void bench_locker(uint32_t arg)
+{
+    int i, j;
+
+    arg = arg;
+
+    for (i = 0; i < bench_lock_rounds; i++) {
+	lock_acquire(&bench_lock);
+	for (j = 0; j < BENCH_LOCK_WORK; j++)
+	    bench_counter++;
+	lock_release(&bench_lock);
+    }
+    semaphore_V(bench_done);
+}
+
+/**
+ * Runs the lock benchmark. All threads repeatedly enter a short
+ * critical section protected by one lock_t. The final value of the
+ * protected counter is checked.
+ *
+ * @param threads Number of threads
+ * @param rounds Number of critical sections per thread
+ *
+ * @return Elapsed cycles, 0 if out of threads or the counter is
+ * wrong.
+ */
+static uint32_t bench_lock_contention(int threads, int rounds)
+{
+    TID_t tids[BENCH_MAX_THREADS];
+    uint32_t start, elapsed;
+    int i, created;
+
+    lock_reset(&bench_lock);
+    lock_set_name(&bench_lock, "bench_lock");
+    bench_counter = 0;
+    bench_lock_rounds = rounds;
+
+    for (created = 0; created < threads; created++) {
+	tids[created] = thread_create(&bench_locker, 0);
+	if (tids[created] < 0)
+	    break;
+    }
+    if (created < threads)
+	bench_lock_rounds = 0;
+
+    start = timer_get_ticks();
+    for (i = 0; i < created; i++)
+	thread_run(tids[i]);
+    for (i = 0; i < created; i++)
+	semaphore_P(bench_done);
+    elapsed = timer_get_ticks() - start;
+
+    if (created < threads 
+	|| bench_counter != (uint32_t)(threads * rounds * BENCH_LOCK_WORK))
+	return 0;
+
+    return elapsed;
+}
+
+/* A consumer thread of the condition variable benchmark */
+static void bench_consumer(uint32_t arg)
+{
+    int i;
+
+    arg = arg;
+
+    for (i = 0; i < bench_lock_rounds; i++) {
+	lock_acquire(&bench_lock);
+	while (bench_items == 0)
+	    condition_wait(&bench_nonempty, &bench_lock);
+	bench_items--;
+	bench_counter++;
+	if (bench_items == 0)
+	    condition_signal(&bench_empty, &bench_lock);
+	lock_release(&bench_lock);
+    }
+    semaphore_V(bench_done);
+}
+
+/**
+ * Runs the condition variable benchmark. The calling thread is the
+ * producer: in each round it waits until the consumers have emptied
+ * the queue, adds one item per consumer and wakes them all with a
+ * broadcast, so every broadcast finds most of the consumers waiting.
+ * The total number of items consumed is checked.
+ *
+ * @param threads Number of consumer threads
+ * @param rounds Number of broadcasts, and items per consumer
+ *
+ * @return Elapsed cycles, 0 if out of threads or the count is wrong.
+ */
+static uint32_t bench_condvar(int threads, int rounds)
+{
+    TID_t tids[BENCH_MAX_THREADS];
+    uint32_t start, elapsed;
+    int i, created;
+
+    lock_reset(&bench_lock);
+    lock_set_name(&bench_lock, "bench_lock");
+    condition_init(&bench_nonempty);
+    condition_init(&bench_empty);
+    bench_items = 0;
+    bench_counter = 0;
+    bench_lock_rounds = rounds;
+
+    for (created = 0; created < threads; created++) {
+	tids[created] = thread_create(&bench_consumer, 0);
+	if (tids[created] < 0)
+	    break;
+    }
+    if (created < threads) {
+	bench_lock_rounds = 0;
+	rounds = 0;
+    }
+
+    start = timer_get_ticks();
+    for (i = 0; i < created; i++)
+	thread_run(tids[i]);
+    for (i = 0; i < rounds; i++) {
+	lock_acquire(&bench_lock);
+	while (bench_items > 0)
+	    condition_wait(&bench_empty, &bench_lock);
+	bench_items += threads;
+	condition_broadcast(&bench_nonempty, &bench_lock);
+	lock_release(&bench_lock);
+    }
+    for (i = 0; i < created; i++)
+	semaphore_P(bench_done);
+    elapsed = timer_get_ticks() - start;
+
+    if (created < threads 
+	|| bench_counter != (uint32_t)(threads * rounds))
+	return 0;
+
+    return elapsed;
+}
+
+/**
+ * Runs a benchmark in the calling thread and returns when it is
+ * over.
+ *
+ * @param bench The benchmark, BENCH_*
+ * @param threads Number of threads (or thread pairs, depending on
+ * the benchmark), at most BENCH_MAX_THREADS
+ * @param rounds Number of iterations in each thread
+ *
+ * @return Elapsed CPU cycles, 0 on error (unknown benchmark, invalid
+ * arguments, another benchmark running or not enough resources).
+ */
+uint32_t bench_run(int bench, int threads, int rounds)
+{
+    interrupt_status_t intr_status;
+    uint32_t elapsed = 0;
+    int busy;
+
+    if (threads < 1 || threads > BENCH_MAX_THREADS || rounds < 0)
+	return 0;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&bench_slock);
+    busy = bench_busy;
+    bench_busy = 1;
+    spinlock_release(&bench_slock);
+    _interrupt_set_state(intr_status);
+
+    if (busy)
+	return 0;
+
+    bench_done = semaphore_create(0);
+    if (bench_done != NULL) {
+	switch (bench) {
+	case BENCH_SEM_PINGPONG:
+	    elapsed = bench_sem_pingpong(threads, rounds);
+	    break;
+	case BENCH_LOCK:
+	    elapsed = bench_lock_contention(threads, rounds);
+	    break;
+	case BENCH_CONDVAR:
+	    elapsed = bench_condvar(threads, rounds);
+	    break;
+	default:
+	    break;
+	}
+	semaphore_destroy(bench_done);
+    }
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&bench_slock);
+    bench_busy = 0;
+    spinlock_release(&bench_slock);
+    _interrupt_set_state(intr_status);
+
+    return elapsed;
+}
+
+/** @} */
+
+#endif /* CONFIG_BENCH */
@@ -0,0 +1,57 @@
+/*
+ * Kernel synchronization benchmarks.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef BUENOS_KERNEL_BENCH_H
+#define BUENOS_KERNEL_BENCH_H
+
+#include "lib/types.h"
+
+/* This header is also included by userland programs, which start the
+   benchmarks through the SYSCALL_BENCH system call. The system call
+   fails unless the kernel is built with CONFIG_BENCH. */
+
+/* Benchmarks */
+#define BENCH_SEM_PINGPONG 1 /* pairs of threads ping-ponging two
+				semaphores */
+#define BENCH_LOCK         2 /* threads contending for one lock_t */
+#define BENCH_CONDVAR      3 /* consumer threads woken by condition
+				broadcasts */
+
+/* Maximum number of threads (or pairs) in one benchmark run */
+#define BENCH_MAX_THREADS 16
+
+void bench_init(void);
+uint32_t bench_run(int bench, int threads, int rounds);
+
+#endif /* BUENOS_KERNEL_BENCH_H */
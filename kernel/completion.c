@@ -0,0 +1,111 @@
+/*
+ * Completions.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "kernel/completion.h"
+#include "kernel/interrupt.h"
+#include "kernel/sleepq.h"
+#include "kernel/thread.h"
+
+/** @name Completions
+ *
+ * A completion lets a thread wait for a single event, typically the
+ * end of an I/O request, signaled by another thread or an interrupt
+ * handler. The completion is embedded in the request itself, so
+ * waiting for a request needs no allocation and cannot fail.
+ *
+ * The waiting thread sleeps on the address of the completion. It
+ * retakes the completion spinlock after waking up, so once
+ * completion_wait has returned the signaler no longer touches the
+ * completion and its memory may be reused.
+ *
+ * @{
+ */
+
+/**
+ * Initializes the completion as not done. Must be called before the
+ * completion is passed to the signaling party.
+ *
+ * @param comp The completion to initialize
+ */
+void completion_reset(completion_t *comp)
+{
+    spinlock_reset(&comp->slock);
+    comp->done = 0;
+}
+
+/**
+ * Waits until the completion has been signaled. Returns immediately
+ * if it already has been. Must not be called by interrupt handlers.
+ *
+ * @param comp The completion to wait for
+ */
+void completion_wait(completion_t *comp)
+{
+    interrupt_status_t intr_status;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&comp->slock);
+
+    while (!comp->done) {
+	sleepq_add(comp);
+	spinlock_release(&comp->slock);
+	thread_switch();
+	spinlock_acquire(&comp->slock);
+    }
+
+    spinlock_release(&comp->slock);
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Marks the completion done and wakes up its waiter. Safe to call
+ * from interrupt handlers.
+ *
+ * @param comp The completion to signal
+ */
+void completion_complete(completion_t *comp)
+{
+    interrupt_status_t intr_status;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&comp->slock);
+
+    comp->done = 1;
+    sleepq_wake_all(comp);
+
+    spinlock_release(&comp->slock);
+    _interrupt_set_state(intr_status);
+}
+
+/** @} */
@@ -37,12 +37,22 @@
 #ifndef BUENOS_CONFIG_H
 #define BUENOS_CONFIG_H
 
-/* Define the maximum number of threads supported by the kernel 
- * Range from 2 (idle + init) to 256 (ASID size)
+/* Define the maximum number of threads supported by the kernel. The
+ * thread table is sized at boot time from the amount of physical
+ * memory (see CONFIG_THREAD_PAGES), but never beyond this limit.
+ * Range from 2 (idle + init) to 65536
  */
-#define CONFIG_MAX_THREADS 32
+#define CONFIG_MAX_THREADS 4096
 
-/* Size of the stack of a kernel thread */
+/* Define the number of physical memory pages per thread used when
+ * sizing the thread table at boot time.
+ * Range from 1 to 1024
+ */
+#define CONFIG_THREAD_PAGES 4
+
+/* Size of the stack of a kernel thread. Stacks are allocated from
+ * the page pool, so this must be the page size.
+ */
 #define CONFIG_THREAD_STACKSIZE 4096
 
 /* Define the maximum number of CPUs supported by the kernel
@@ -51,22 +61,122 @@
  */
 #define CONFIG_MAX_CPUS 4
 
+/* Define to 1 to collect acquisition, spin and hold time statistics
+ * of every spinlock. The statistics are printed at shutdown. This
+ * makes spinlocks larger and slower.
+ * Range from 0 to 1
+ */
+#define CONFIG_SPINLOCK_STATS 0
+
+/* Maximum number of spinlocks whose statistics are printed.
+ * Range from 16 to 4096
+ */
+#define CONFIG_SPINLOCK_STATS_LOCKS 256
+
+/* Define to 1 to profile the contention of named semaphores, locks
+ * and reader-writer locks. The profile is printed at shutdown.
+ * Range from 0 to 1
+ */
+#define CONFIG_LOCK_PROFILE 0
+
+/* Maximum number of distinct lock names in the lock profile.
+ * Range from 8 to 1024
+ */
+#define CONFIG_LOCK_PROFILE_RECORDS 32
+
+/* Number of waiting call sites kept for each lock name.
+ * Range from 1 to 16
+ */
+#define CONFIG_LOCK_PROFILE_SITES 4
+
+/* Define to 1 to build the kernel synchronization benchmarks run
+ * through SYSCALL_BENCH (see kernel/bench.c). Without them the system
+ * call fails.
+ * Range from 0 to 1
+ */
+#define CONFIG_BENCH 0
+
+/* Number of free objects of each slab cache kept by each CPU (see
+ * kernel/slab.c).
+ * Range from 2 to 128
+ */
+#define CONFIG_SLAB_MAGAZINE_SIZE 16
+
+/* Largest order of physically contiguous page blocks in the page
+ * pool, the blocks being 2^order pages.
+ * Range from 0 to 15
+ */
+#define CONFIG_PAGEPOOL_MAX_ORDER 10
+
+/* Number of free single pages cached per CPU in front of the page
+ * pool free lists (see vm/pagepool.c).
+ * Range from 2 to 128
+ */
+#define CONFIG_PAGEPOOL_CACHE_SIZE 16
+
+/* Number of pre-zeroed pages kept by the page pool's background
+ * zeroing thread for pagepool_get_zeroed_page. The thread is woken
+ * when fewer than half of them are left.
+ * Range from 2 to 1024
+ */
+#define CONFIG_PAGEPOOL_ZEROED_PAGES 32
+
+/* Define to 1 to print the page pool cache and zeroed page counters
+ * at shutdown.
+ * Range from 0 to 1
+ */
+#define CONFIG_PAGEPOOL_STATS 0
+
 /* Define the length of scheduling interval (timeslice) in 
  * processor cycles. 
  * Range from 200 to 2000000000.
  */
 #define CONFIG_SCHEDULER_TIMESLICE 750
 
+/* Define the number of priority levels in the multi-level feedback
+ * queue scheduler. The timeslice doubles on each lower level.
+ * Range from 1 to 8.
+ */
+#define CONFIG_SCHEDULER_LEVELS 4
+
+/* Define the interval in processor cycles after which all threads are
+ * boosted back to the highest priority level.
+ * Range from 10000 to 2000000000.
+ */
+#define CONFIG_SCHEDULER_BOOST_INTERVAL 100000
+
+/* Define to 1 to stop the timer tick on CPUs which have nothing to
+ * run. Idle CPUs then sleep in the WAIT instruction until an
+ * interrupt arrives, and CPUs queueing new work wake them up with
+ * a reschedule IPI. Define to 0 to keep ticking.
+ * Range from 0 to 1.
+ */
+#define CONFIG_SCHEDULER_TICKLESS_IDLE 1
+
+/* Maximum number of iterations a thread spins waiting for a lock_t
+ * held by a thread running on another CPU before going to sleep.
+ * 0 makes the locks always sleep.
+ * Range from 0 to 100000
+ */
+#define CONFIG_LOCK_SPIN_LIMIT 2000
+
+/* Number of records in the scheduler trace ring of each CPU.
+ * Range from 16 to 4096.
+ */
+#define CONFIG_SCHEDULER_TRACE_ENTRIES 128
+
 /* Sets the maximum number of boot arguments that the kernel will 
  * accept.
  * Range from 1 to 1024
  */ 
 #define CONFIG_BOOTARGS_MAX 32
 
-/* Define the maximum number of semaphores.
+/* Define the number of statically allocated semaphores. These are
+ * used before the page pool is initialized; further semaphores are
+ * allocated a page at a time.
  * Range from 16 to 1024
  */
-#define CONFIG_MAX_SEMAPHORES 128
+#define CONFIG_BOOT_SEMAPHORES 32
 
 /* Define maximum number of devices.
  * Range from 16 to 128
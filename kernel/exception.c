@@ -56,7 +56,7 @@ static void print_tlb_debug(void)
    kprintf("TLB exception. Details:\n"
            "Failed Virtual Address: 0x%8.8x\n"
            "Virtual Page Number:    0x%8.8x\n"
-           "ASID (Thread number):   %d\n",
+           "ASID:                   %d\n",
            tes.badvaddr, tes.badvpn2, tes.asid);
 }
 
@@ -37,6 +37,10 @@
 #include "drivers/metadev.h"
 #include "lib/libc.h"
 #include "fs/vfs.h"
+#include "kernel/config.h"
+#include "kernel/spinlock.h"
+#include "kernel/lockprof.h"
+#include "vm/pagepool.h"
 
 /**
  * Halt the kernel.
@@ -49,6 +53,18 @@ void halt_kernel(void)
     /* Unmount all filesystems */
     vfs_deinit();
 
+#if CONFIG_PAGEPOOL_STATS
+    pagepool_print_stats();
+#endif
+
+#if CONFIG_SPINLOCK_STATS
+    spinlock_stats_print();
+#endif
+
+#if CONFIG_LOCK_PROFILE
+    lockprof_print();
+#endif
+
     kprintf("Kernel: System shutdown complete, powering off\n");
     shutdown(POWEROFF_SHUTDOWN_MAGIC);
 }
@@ -42,8 +42,10 @@
 #include "kernel/interrupt.h"
 #include "drivers/polltty.h"
 #include "kernel/thread.h"
+#include "kernel/timeout.h"
 #include "lib/libc.h"
 #include "vm/tlb.h"
+#include "vm/asid.h"
 
 /* Interrupt vector addresses (only these three should be ever used) */
 #define INTERRUPT_VECTOR_ADDRESS1 0x80000000
@@ -84,11 +86,12 @@ void interrupt_init(int num_cpus) {
         interrupt_stacks[i] = ret+PAGE_SIZE-4;
     }
 
-    /* Copy the interrupt vector code to its positions.All vectors
-     * will contain the same code.
+    /* Copy the interrupt vector code to its positions. The TLB
+     * refill vector gets the refill handler, the others the same
+     * context switch code.
      */
     for(i = 0 ; i < INTERRUPT_VECTOR_LENGTH ; i++) {
-	iv_area1[i] = ((uint32_t *) &_cswitch_vector_code)[i];
+	iv_area1[i] = ((uint32_t *) &_tlb_refill_vector_code)[i];
 	iv_area2[i] = ((uint32_t *) &_cswitch_vector_code)[i];
 	iv_area3[i] = ((uint32_t *) &_cswitch_vector_code)[i];
     }
@@ -179,6 +182,10 @@ void interrupt_handle(uint32_t cause) {
     }
 
 
+    /* Run the timeouts which have expired */
+    if (cause & INTERRUPT_CAUSE_HARDWARE_5)
+	timeout_tick();
+
     /* Timer interrupt (HW5) or requested context switch (SW0)
      * Also call scheduler if we're running the idle thread.
      */
@@ -186,18 +193,11 @@ void interrupt_handle(uint32_t cause) {
 		 INTERRUPT_CAUSE_HARDWARE_5)) ||
        scheduler_current_thread[this_cpu] == IDLE_THREAD_TID) {
 	scheduler_schedule();
-	
-	/* Until we have proper VM we must manually fill
-	   the TLB with pagetable entries before running code using
-	   given pagetable. Note that this method limits pagetable
-	   rows (possible mapping pairs) to 16 and can't be used
-	   with proper pagetables and VM.
-
-           Note that if you remove this call (which you probably do when
-           you implement proper VM), you must manually call _tlb_set_asid
-           here. See the implementation of tlb_fill on details how to do that.
-        */
-	// tlb_fill(thread_get_current_thread_entry()->pagetable);
-	_tlb_set_asid(thread_get_current_thread_entry()->pagetable->ASID);
+
+	/* Switch the TLB to the address space of the new thread. The
+	   TLB is filled on demand by the TLB exception handlers, and
+	   entries of other address spaces may stay in it since every
+	   address space has its own ASID. */
+	asid_activate(thread_get_current_thread_entry()->pagetable);
     }
 }
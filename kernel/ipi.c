@@ -0,0 +1,353 @@
+/*
+ * Inter-processor interrupts.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "kernel/ipi.h"
+#include "kernel/config.h"
+#include "kernel/spinlock.h"
+#include "kernel/interrupt.h"
+#include "kernel/assert.h"
+#include "drivers/device.h"
+#include "drivers/metadev.h"
+#include "drivers/yams.h"
+#include "vm/tlb.h"
+#include "vm/asid.h"
+#include "lib/libc.h"
+
+/** @name Inter-processor interrupts
+ *
+ * Messages between CPUs are delivered through the CPU status devices
+ * of YAMS. Each CPU has a mailbox into which other CPUs post
+ * messages before raising the interrupt of its CPU status device.
+ * The interrupt handler of the CPU status device then processes the
+ * mailbox (see cpustatus_interrupt_handle).
+ *
+ * Three kinds of messages are supported:
+ *
+ * A reschedule request makes the target CPU run the scheduler after
+ * the interrupt, so that an idle CPU picks up new work immediately
+ * instead of at its next timer tick.
+ *
+ * A remote call runs a function on the target CPU in interrupt
+ * context. The caller waits until the function has returned.
+ *
+ * A TLB shootdown invalidates the TLB entries of an address space on
+ * all other CPUs. Shootdowns posted to the same CPU before it gets
+ * to handle them are merged. The caller waits until all CPUs have
+ * done the invalidation.
+ *
+ * Any CPU waiting for another one keeps processing its own mailbox,
+ * so two CPUs waiting for each other with interrupts disabled do not
+ * deadlock.
+ *
+ * @{
+ */
+
+/* Per-CPU mailbox */
+typedef struct {
+    /* Spinlock protecting the mailbox */
+    spinlock_t slock;
+    /* Posted message types (IPI_*) not yet handled */
+    uint32_t pending;
+
+    /* Remote call slot. Only one call can be outstanding per CPU;
+       call_busy is set by the caller owning the slot. */
+    volatile int call_busy;
+    volatile int call_done;
+    void (*call_func)(void *);
+    void *call_arg;
+
+    /* Hardware ASIDs whose TLB entries must be invalidated */
+    uint32_t shootdown_asids[ASID_HW_COUNT / 32];
+    /* Set if the whole TLB must be flushed */
+    int shootdown_all;
+    /* Number of shootdown requests posted and handled */
+    uint32_t shootdown_seq;
+    volatile uint32_t shootdown_done;
+} ipi_mailbox_t;
+
+static ipi_mailbox_t ipi_mailboxes[CONFIG_MAX_CPUS];
+
+/* CPU status devices used to interrupt the CPUs */
+static device_t *ipi_devices[CONFIG_MAX_CPUS];
+
+/* Number of CPUs in the system */
+static int ipi_num_cpus;
+
+/**
+ * Initializes the IPI mailboxes and finds the CPU status devices of
+ * all CPUs. Must be called after the device drivers have been
+ * initialized.
+ *
+ * @param num_cpus Number of CPUs in the system
+ */
+void ipi_init(int num_cpus)
+{
+    int i;
+
+    ipi_num_cpus = num_cpus;
+
+    for (i = 0; i < CONFIG_MAX_CPUS; i++) {
+	memoryset(&ipi_mailboxes[i], 0, sizeof(ipi_mailbox_t));
+	spinlock_reset(&ipi_mailboxes[i].slock);
+	spinlock_stats_register(&ipi_mailboxes[i].slock);
+	ipi_devices[i] = NULL;
+	if (i < num_cpus) {
+	    ipi_devices[i] = device_get(YAMS_TYPECODE_CPUSTATUS | i, 0);
+	    KERNEL_ASSERT(ipi_devices[i] != NULL);
+	}
+    }
+}
+
+/**
+ * Posts a message to the mailbox of the given CPU and interrupts it.
+ * The mailbox spinlock must be held; it is released here.
+ *
+ * @param cpu Target CPU
+ * @param type Message type (IPI_*)
+ */
+static void ipi_post(int cpu, uint32_t type)
+{
+    ipi_mailboxes[cpu].pending |= type;
+    spinlock_release(&ipi_mailboxes[cpu].slock);
+
+    cpustatus_generate_irq(ipi_devices[cpu]);
+}
+
+/**
+ * Processes the mailbox of the calling CPU. Called by the interrupt
+ * handler of the CPU status device, and by CPUs spinning while they
+ * wait for another CPU. Interrupts must be disabled.
+ */
+void ipi_handle(void)
+{
+    ipi_mailbox_t *mbox;
+    uint32_t pending, seq = 0;
+    uint32_t asids[ASID_HW_COUNT / 32];
+    int all = 0, i, j;
+
+    mbox = &ipi_mailboxes[_interrupt_getcpu()];
+
+    spinlock_acquire(&mbox->slock);
+    pending = mbox->pending;
+    mbox->pending = 0;
+    if (pending & IPI_TLB_SHOOTDOWN) {
+	for (i = 0; i < ASID_HW_COUNT / 32; i++) {
+	    asids[i] = mbox->shootdown_asids[i];
+	    mbox->shootdown_asids[i] = 0;
+	}
+	all = mbox->shootdown_all;
+	mbox->shootdown_all = 0;
+	seq = mbox->shootdown_seq;
+    }
+    spinlock_release(&mbox->slock);
+
+    if (pending & IPI_RESCHEDULE) {
+	/* The scheduler runs when the interrupt handler returns */
+	_interrupt_generate_sw0();
+    }
+
+    if (pending & IPI_TLB_SHOOTDOWN) {
+	if (all) {
+	    tlb_flush();
+	} else {
+	    for (i = 0; i < ASID_HW_COUNT / 32; i++) {
+		for (j = 0; j < 32 && asids[i] != 0; j++) {
+		    if (asids[i] & (1 << j)) {
+			tlb_flush_asid(i * 32 + j);
+			asids[i] &= ~(1 << j);
+		    }
+		}
+	    }
+	}
+	mbox->shootdown_done = seq;
+    }
+
+    if (pending & IPI_CALL) {
+	mbox->call_func(mbox->call_arg);
+	mbox->call_done = 1;
+    }
+}
+
+/**
+ * Asks the given CPU to run its scheduler. Used to wake up idle
+ * CPUs when new threads become ready. Does nothing if the target is
+ * the calling CPU.
+ *
+ * @param cpu Target CPU
+ */
+void ipi_reschedule(int cpu)
+{
+    interrupt_status_t intr_status;
+
+    if (cpu == _interrupt_getcpu() || ipi_devices[cpu] == NULL)
+	return;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&ipi_mailboxes[cpu].slock);
+    if (ipi_mailboxes[cpu].pending & IPI_RESCHEDULE) {
+	/* Already on its way */
+	spinlock_release(&ipi_mailboxes[cpu].slock);
+    } else {
+	ipi_post(cpu, IPI_RESCHEDULE);
+    }
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Runs the given function on the given CPU and waits for it to
+ * return. The function is run in interrupt context with interrupts
+ * disabled, so it must not block. If the target is the calling CPU
+ * the function is simply called.
+ *
+ * @param cpu Target CPU
+ * @param func Function to call
+ * @param arg Argument for func
+ */
+void ipi_call(int cpu, void (*func)(void *), void *arg)
+{
+    interrupt_status_t intr_status;
+    ipi_mailbox_t *mbox = &ipi_mailboxes[cpu];
+
+    KERNEL_ASSERT(cpu >= 0 && cpu < ipi_num_cpus);
+
+    intr_status = _interrupt_disable();
+
+    if (cpu == _interrupt_getcpu()) {
+	func(arg);
+	_interrupt_set_state(intr_status);
+	return;
+    }
+
+    /* Reserve the call slot of the target */
+    spinlock_acquire(&mbox->slock);
+    while (mbox->call_busy) {
+	spinlock_release(&mbox->slock);
+	ipi_handle();
+	spinlock_acquire(&mbox->slock);
+    }
+    mbox->call_busy = 1;
+    mbox->call_done = 0;
+    mbox->call_func = func;
+    mbox->call_arg  = arg;
+    ipi_post(cpu, IPI_CALL);
+
+    while (!mbox->call_done)
+	ipi_handle();
+
+    mbox->call_busy = 0;
+
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Invalidates the TLB entries of the given address space on all
+ * CPUs and waits until every CPU has done so.
+ *
+ * @param asid Hardware ASID whose entries are invalidated, or
+ * IPI_SHOOTDOWN_ALL to flush the whole TLB
+ */
+void ipi_tlb_shootdown(uint32_t asid)
+{
+    interrupt_status_t intr_status;
+    uint32_t wait_for[CONFIG_MAX_CPUS];
+    int this_cpu, i;
+
+    KERNEL_ASSERT(asid == IPI_SHOOTDOWN_ALL || asid < ASID_HW_COUNT);
+
+    intr_status = _interrupt_disable();
+    this_cpu = _interrupt_getcpu();
+
+    for (i = 0; i < ipi_num_cpus; i++) {
+	if (i == this_cpu)
+	    continue;
+
+	spinlock_acquire(&ipi_mailboxes[i].slock);
+	if (asid == IPI_SHOOTDOWN_ALL) {
+	    ipi_mailboxes[i].shootdown_all = 1;
+	} else {
+	    ipi_mailboxes[i].shootdown_asids[asid / 32] |= 1 << (asid % 32);
+	}
+	wait_for[i] = ++ipi_mailboxes[i].shootdown_seq;
+	ipi_post(i, IPI_TLB_SHOOTDOWN);
+    }
+
+    if (asid == IPI_SHOOTDOWN_ALL) {
+	tlb_flush();
+    } else {
+	tlb_flush_asid(asid);
+    }
+
+    for (i = 0; i < ipi_num_cpus; i++) {
+	if (i == this_cpu)
+	    continue;
+	/* The sequence numbers may wrap, compare the difference */
+	while ((int32_t)(ipi_mailboxes[i].shootdown_done - wait_for[i]) < 0)
+	    ipi_handle();
+    }
+
+    _interrupt_set_state(intr_status);
+}
+
+/* Remote call of ipi_selftest. Records the CPU it runs on and does a
+   shootdown while the calling CPU waits for the call to return. */
+static void ipi_selftest_call(void *arg)
+{
+    *(int *)arg = _interrupt_getcpu();
+
+    /* No address space has hardware ASID 0 */
+    ipi_tlb_shootdown(0);
+}
+
+/**
+ * Checks that remote calls and TLB shootdowns work on all CPUs. Each
+ * CPU is called in turn and does a shootdown from within the call,
+ * so the waiting caller must handle it too. Finally the TLBs of all
+ * CPUs are flushed. Called once by the startup thread after all CPUs
+ * have been let run; panics if a call ends up on the wrong CPU, and
+ * hangs if some CPU does not respond.
+ */
+void ipi_selftest(void)
+{
+    int cpu, ran;
+
+    for (cpu = 0; cpu < ipi_num_cpus; cpu++) {
+	ran = -1;
+	ipi_call(cpu, &ipi_selftest_call, &ran);
+	KERNEL_ASSERT(ran == cpu);
+    }
+
+    ipi_tlb_shootdown(IPI_SHOOTDOWN_ALL);
+}
+
+/** @} */
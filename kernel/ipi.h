@@ -0,0 +1,56 @@
+/*
+ * Inter-processor interrupts.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef BUENOS_KERNEL_IPI_H
+#define BUENOS_KERNEL_IPI_H
+
+#include "lib/types.h"
+
+/* Message types in the per-CPU IPI mailbox */
+#define IPI_RESCHEDULE    0x00000001
+#define IPI_CALL          0x00000002
+#define IPI_TLB_SHOOTDOWN 0x00000004
+
+/* ASID argument of ipi_tlb_shootdown meaning all address spaces */
+#define IPI_SHOOTDOWN_ALL 0xffffffff
+
+void ipi_init(int num_cpus);
+void ipi_handle(void);
+
+void ipi_reschedule(int cpu);
+void ipi_call(int cpu, void (*func)(void *), void *arg);
+void ipi_tlb_shootdown(uint32_t asid);
+void ipi_selftest(void);
+
+#endif /* BUENOS_KERNEL_IPI_H */
@@ -38,17 +38,42 @@
 #include "lib/libc.h"
 #include "drivers/device.h"
 #include "kernel/kmalloc.h"
+#include "kernel/slab.h"
 #include "kernel/panic.h"
+#include "vm/pagepool.h"
 
-/** @name Permanent kernel memory allocation
+/** @name Kernel memory allocation
  *
- * This module implements permanent kernel memory allocation in
- * unmapped memory. The memory is allocated after the kernel image.
- * The memory allocated through this module cannot be freed.
+ * This module implements kernel memory allocation in unmapped
+ * memory. During boot, until the virtual memory system is
+ * initialized, memory is allocated permanently after the kernel
+ * image. Memory allocated during boot cannot be freed.
+ *
+ * After boot kmalloc allocates from the slab caches of the size
+ * classes 16, 32, ..., KMEM_MAX_OBJECT_SIZE bytes (see
+ * kernel/slab.c). Larger requests get a block of physically
+ * contiguous pages from the page pool, rounded up to a power of two
+ * pages. This memory is freed with kfree.
  *
  * @{
  */
 
+/* Smallest size class, and the number of size classes */
+#define KMALLOC_MIN_CLASS 16
+#define KMALLOC_CLASSES 8
+
+/* Slab caches of the size classes */
+static kmem_cache_t kmalloc_caches[KMALLOC_CLASSES];
+
+/* Names of the size class caches */
+static const char *kmalloc_cache_names[KMALLOC_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048"
+};
+
+/* End of the memory allocated during boot */
+static uint32_t boot_area_end;
+
 /* Special symbol, which is put to the end of the kernel binary by the
    linker */
 extern uint32_t KERNEL_ENDS_HERE;
@@ -114,6 +139,7 @@ int kmalloc_get_reserved_pages()
  */
 void kmalloc_disable()
 {
+    boot_area_end = free_area_start;
     free_area_start = 0xffffffff;
 }
 
@@ -128,9 +154,15 @@ void kmalloc_disable()
 void kmalloc_init(void)
 {
     uint32_t system_memory_size = 0;
+    int i;
 
     io_descriptor_t UNUSED *io_desc;
 
+    for (i = 0; i < KMALLOC_CLASSES; i++) {
+        kmem_cache_init(&kmalloc_caches[i], kmalloc_cache_names[i],
+                        KMALLOC_MIN_CLASS << i);
+    }
+
     memory_end = 0;
     io_desc = (io_descriptor_t *)IO_DESCRIPTOR_AREA;
     
@@ -156,21 +188,54 @@ void kmalloc_init(void)
 }
 
 /**
- * Allocates permanent memory for the kernel in unmapped memory. Call
- * of this function after virtual memory has been initialized will
- * cause kernel panic. Panics if memory can't be allocated.
+ * Allocates memory after boot from the size class caches or the page
+ * pool.
  *
  * @param bytes The number of bytes to be allocated.
  *
- * @return The start address of the reseved memory address.
+ * @return The allocated memory, NULL if out of memory or too large.
+ */
+static void *kmalloc_freeable(int bytes)
+{
+    uint32_t page;
+    int i, order;
+
+    for (i = 0; i < KMALLOC_CLASSES; i++) {
+        if (bytes <= (KMALLOC_MIN_CLASS << i))
+            return kmem_cache_alloc(&kmalloc_caches[i]);
+    }
+
+    for (order = 0; (PAGE_SIZE << order) < bytes; order++) {
+        if (order == CONFIG_PAGEPOOL_MAX_ORDER)
+            return NULL;
+    }
+
+    page = pagepool_get_phys_pages(order);
+    if (page == 0)
+        return NULL;
+
+    return (void *)ADDR_PHYS_TO_KERNEL(page);
+}
+
+/**
+ * Allocates memory for the kernel in unmapped memory. Before virtual
+ * memory has been initialized the memory is permanent, and the
+ * kernel panics if it can't be allocated. After that the memory can
+ * be freed with kfree.
+ *
+ * @param bytes The number of bytes to be allocated. After boot at
+ * most 2^CONFIG_PAGEPOOL_MAX_ORDER pages.
+ *
+ * @return The start address of the reseved memory address. NULL if
+ * out of memory after boot.
  */
 void *kmalloc(int bytes)
 {
     uint32_t res;
 
-    /* Panic if VM is initialized */
+    /* After VM initialization allocate freeable memory */
     if (free_area_start == 0xffffffff){
-        KERNEL_PANIC("Attempting to use kmalloc after vm init\n");
+        return kmalloc_freeable(bytes);
     }
 
     if (free_area_start == 0) {
@@ -198,5 +263,30 @@ void *kmalloc(int bytes)
     return (void *)res;
 }
 
+/**
+ * Frees memory allocated with kmalloc after boot. Memory allocated
+ * during boot cannot be freed.
+ *
+ * @param ptr The memory, NULL is ignored
+ */
+void kfree(void *ptr)
+{
+    uint32_t addr = (uint32_t)ptr;
+
+    if (ptr == NULL)
+        return;
+
+    if (boot_area_end == 0 || addr < boot_area_end)
+        KERNEL_PANIC("Attempting to kfree memory allocated during boot\n");
+
+    if ((addr & ~PAGE_SIZE_MASK) == 0) {
+        /* a block of pages, slab objects are never page aligned */
+        addr = ADDR_KERNEL_TO_PHYS(addr);
+        pagepool_free_phys_pages(addr, pagepool_get_order(addr));
+    } else {
+        kmem_cache_free(kmem_cache_of(ptr), ptr);
+    }
+}
+
 
 /** @} */
@@ -46,7 +46,8 @@ void kmalloc_disable();
 /* Initialize the memory allocator */
 void kmalloc_init(void);
 
-/* Permanent kernel memory allocation */
+/* Kernel memory allocation, permanent during boot */
 void *kmalloc(int bytes);
+void kfree(void *ptr);
 
 #endif
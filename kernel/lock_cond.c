@@ -1,76 +1,284 @@
+/*
+ * Locks and condition variables.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
 #include "kernel/lock_cond.h"
 #include "kernel/sleepq.h"
 #include "kernel/thread.h"
 #include "kernel/interrupt.h"
 #include "kernel/spinlock.h"
+#include "kernel/config.h"
+#include "kernel/assert.h"
+
+/** @name Locks and condition variables
+ *
+ * A lock_t is an adaptive mutex. A thread finding the lock held
+ * spins as long as the owner is running on another CPU, since the
+ * owner is then likely to release the lock before a sleep and wakeup
+ * would complete. If the owner is not running, or the spin lasts
+ * more than CONFIG_LOCK_SPIN_LIMIT iterations, the thread goes to
+ * sleep on the lock. Releasing the lock wakes one sleeper, which
+ * then competes for the lock with any spinning threads.
+ *
+ * Condition variables are Mesa style: a woken waiter reacquires the
+ * lock and must recheck its condition. Signalling and broadcasting
+ * must be done while holding the lock used with the condition.
+ *
+ * Broadcasting uses wait morphing. Since the broadcaster holds the
+ * lock, all but one of the waiters would only wake up to go back to
+ * sleep on the lock. Instead, one waiter is woken and the rest are
+ * moved from the condition to the sleep queue of the lock without
+ * waking them. Each lock release then wakes one of them, and it
+ * returns from condition_wait to acquire the lock.
+ *
+ * @{
+ */
+
+extern thread_table_t *thread_table;
+
+/* Returns nonzero if the given thread is running on some CPU. The
+   state is read without locking, it is only a hint. */
+static inline int lock_owner_running(TID_t owner)
+{
+    return ((volatile thread_table_t *)&thread_table[owner])->state 
+	== THREAD_RUNNING;
+}
+
+/**
+ * Initializes the lock as free. Must not be called on a lock which
+ * may be in use.
+ *
+ * @param lock The lock to initialize
+ *
+ * @return LOCK_RESET_SUCCESS
+ */
+int lock_reset(lock_t *lock)
+{
+    spinlock_reset(&lock->slock);
+    lock->owner = -1;
+    lock->waiters = 0;
+#if CONFIG_LOCK_PROFILE
+    lock->prof = NULL;
+#endif
+
+    return LOCK_RESET_SUCCESS;
+}
 
-#define LOCK_RESET_SUCCESS 0
-#define LOCK_RESET_FAILURE -1
-#define LOCK_OPEN 0
-#define LOCK_CLOSED 1
+/**
+ * Gives the lock a name under which its contention is profiled with
+ * CONFIG_LOCK_PROFILE. Does nothing if profiling is not enabled.
+ *
+ * @param lock The lock
+ * @param name Name of the lock, must stay in memory
+ */
+void lock_set_name(lock_t *lock, const char *name)
+{
+#if CONFIG_LOCK_PROFILE
+    lock->prof = lockprof_register(name);
+#else
+    lock = lock;
+    name = name;
+#endif
+}
 
-int lock_reset (lock_t *lock)
+/* Acquires the lock. Returns nonzero if the lock was not free. */
+static int lock_take(lock_t *lock)
 {
-  interrupt_status_t state = _interrupt_disable();
-  spinlock_acquire(lock);
-  if (*lock == LOCK_CLOSED) {
-    spinlock_release(lock);
-    _interrupt_set_state(state);
-    return LOCK_RESET_FAILURE;
-  }
-  *lock = LOCK_OPEN;    
-  spinlock_release(lock);
-  _interrupt_set_state(state);
-  return LOCK_RESET_SUCCESS;
+    interrupt_status_t intr_status;
+    TID_t me, owner;
+    int spins;
+    int contended = 0;
+
+    me = thread_get_current_thread();
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&lock->slock);
+
+    while ((owner = lock->owner) >= 0) {
+	KERNEL_ASSERT(owner != me);
+	contended = 1;
+
+	if (lock_owner_running(owner)) {
+	    /* The owner is on another CPU: spin without the spinlock
+	       until it releases the lock or stops running. Interrupts
+	       are enabled while spinning so that they are not held off
+	       for the whole spin. */
+	    spinlock_release(&lock->slock);
+	    _interrupt_set_state(intr_status);
+	    spins = 0;
+	    while (lock->owner == owner 
+		   && lock_owner_running(owner)
+		   && spins < CONFIG_LOCK_SPIN_LIMIT)
+		spins++;
+	    _interrupt_disable();
+	    spinlock_acquire(&lock->slock);
+
+	    if (spins < CONFIG_LOCK_SPIN_LIMIT)
+		continue;
+	    if (lock->owner < 0)
+		continue;
+	}
+
+	/* The owner is descheduled or holding the lock for long */
+	lock->waiters++;
+	sleepq_add(lock);
+	spinlock_release(&lock->slock);
+	thread_switch();
+	spinlock_acquire(&lock->slock);
+    }
+
+    lock->owner = me;
+
+    spinlock_release(&lock->slock);
+    _interrupt_set_state(intr_status);
+
+    return contended;
 }
 
+/**
+ * Acquires the lock, spinning or sleeping until it is free. Locks
+ * are not recursive. Must not be called by interrupt handlers.
+ *
+ * @param lock The lock to acquire
+ */
 void lock_acquire(lock_t *lock)
 {
-  interrupt_status_t state = _interrupt_disable();
-  spinlock_acquire(lock);
-  /* While lock is closed, since LOCK_CLOSED == 1 */
-  while (*lock) {
-    sleepq_add(lock);
-    spinlock_release(lock);
-    thread_switch();
-    spinlock_acquire(lock);
-  }
-  *lock = LOCK_CLOSED;
-  spinlock_release(lock);
-  _interrupt_set_state(state);
+    LOCKPROF_ACQUIRE(lock->prof, lock_take(lock));
 }
 
+/**
+ * Releases the lock and wakes up one thread sleeping on it, if any.
+ * Must be called by the thread holding the lock.
+ *
+ * @param lock The lock to release
+ */
 void lock_release(lock_t *lock)
 {
-  interrupt_status_t state = _interrupt_disable();
-  spinlock_acquire(lock);
-  *lock = LOCK_OPEN;
-  sleepq_wake(lock);
-  spinlock_release(lock);
-  _interrupt_set_state(state);
+    interrupt_status_t intr_status;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&lock->slock);
+
+    KERNEL_ASSERT(lock->owner == thread_get_current_thread());
+
+    lock->owner = -1;
+    if (lock->waiters > 0) {
+	lock->waiters--;
+	sleepq_wake(lock);
+    }
+
+    spinlock_release(&lock->slock);
+    _interrupt_set_state(intr_status);
 }
 
+/**
+ * Initializes the condition variable.
+ *
+ * @param cond The condition variable
+ */
 void condition_init(cond_t *cond)
 {
-  *cond = 42;
+    cond->waiters = 0;
 }
 
+/**
+ * Releases the lock, waits until the condition is signalled and
+ * reacquires the lock. The calling thread is queued on the condition
+ * before the lock is released, so a signal sent after the release
+ * cannot be missed.
+ *
+ * @param cond The condition to wait for
+ * @param lock The lock held by the calling thread
+ */
 void condition_wait(cond_t *cond, lock_t *lock)
 {
-  lock_release(lock);
-  sleepq_add(cond);
-  thread_switch();
-  lock_acquire(lock);
+    interrupt_status_t intr_status;
+
+    intr_status = _interrupt_disable();
+
+    cond->waiters++;
+    sleepq_add(cond);
+    lock_release(lock);
+    thread_switch();
+
+    _interrupt_set_state(intr_status);
+
+    lock_acquire(lock);
 }
 
+/**
+ * Wakes up one thread waiting on the condition, if any.
+ *
+ * @param cond The condition to signal
+ * @param lock The lock used with the condition, held by the caller
+ */
 void condition_signal(cond_t *cond, lock_t *lock)
 {
-  lock = lock;
-  sleepq_wake(cond);
+    KERNEL_ASSERT(lock->owner == thread_get_current_thread());
+
+    if (cond->waiters > 0) {
+	cond->waiters--;
+	sleepq_wake(cond);
+    }
 }
 
+/**
+ * Wakes up all threads waiting on the condition. One of them is made
+ * runnable at once, the others are moved to wait for the lock.
+ *
+ * @param cond The condition to broadcast
+ * @param lock The lock used with the condition, held by the caller
+ */
 void condition_broadcast(cond_t *cond, lock_t *lock)
 {
-  lock = lock;
-  sleepq_wake_all(cond);
+    interrupt_status_t intr_status;
+    int moved;
+
+    KERNEL_ASSERT(lock->owner == thread_get_current_thread());
+
+    if (cond->waiters > 0) {
+	cond->waiters = 0;
+	sleepq_wake(cond);
+
+	/* The lock is held by the caller, so it cannot be released
+	   before the waiters are counted */
+	intr_status = _interrupt_disable();
+	spinlock_acquire(&lock->slock);
+	moved = sleepq_requeue(cond, lock);
+	lock->waiters += moved;
+	spinlock_release(&lock->slock);
+	_interrupt_set_state(intr_status);
+    }
 }
+
+/** @} */
@@ -1,26 +1,76 @@
-#include "kernel/sleepq.h"
+/*
+ * Locks and condition variables.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
 
-typedef int lock_t;
+#ifndef BUENOS_KERNEL_LOCK_COND_H
+#define BUENOS_KERNEL_LOCK_COND_H
 
-typedef int cond_t;
+#include "kernel/spinlock.h"
+#include "kernel/thread.h"
+#include "kernel/lockprof.h"
 
-/*
+#define LOCK_RESET_SUCCESS 0
+#define LOCK_RESET_FAILURE -1
+
+/* Sleeping mutual exclusion lock */
 typedef struct {
-  cond_t value;
-  
+    /* protects the fields below */
+    spinlock_t slock;
+    /* thread holding the lock, negative if the lock is free */
+    volatile TID_t owner;
+    /* number of threads sleeping on the lock */
+    int waiters;
+#if CONFIG_LOCK_PROFILE
+    /* contention record, NULL if the lock is not named */
+    lockprof_t *prof;
+#endif
 } lock_t;
-*/
 
-int lock_reset(lock_t *lock);
+/* Condition variable, used together with a lock_t */
+typedef struct {
+    /* number of threads waiting on the condition, protected by the
+       lock used with the condition */
+    int waiters;
+} cond_t;
 
+int lock_reset(lock_t *lock);
+void lock_set_name(lock_t *lock, const char *name);
 void lock_acquire(lock_t *lock);
-
 void lock_release(lock_t *lock);
 
 void condition_init(cond_t *cond);
-
 void condition_wait(cond_t *cond, lock_t *lock);
-
 void condition_signal(cond_t *cond, lock_t *lock);
-
 void condition_broadcast(cond_t *cond, lock_t *lock);
+
+#endif /* BUENOS_KERNEL_LOCK_COND_H */
@@ -0,0 +1,225 @@
+/*
+ * Lock contention profiler.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "kernel/config.h"
+
+#if CONFIG_LOCK_PROFILE
+
+#include "kernel/lockprof.h"
+#include "kernel/interrupt.h"
+#include "lib/libc.h"
+
+/** @name Lock contention profiler
+ *
+ * With CONFIG_LOCK_PROFILE semaphores, locks and reader-writer locks
+ * which have been given a name count their acquisitions, how many of
+ * them had to wait, and how long the waits took in total and at
+ * most. For each name the CONFIG_LOCK_PROFILE_SITES call sites which
+ * have waited longest are also kept. The sites are return addresses,
+ * which can be looked up in the kernel symbol map.
+ *
+ * The records are taken from a static pool of
+ * CONFIG_LOCK_PROFILE_RECORDS entries. Locks registered with the
+ * same name share a record, so for example all TFS instances are
+ * accounted together. Unnamed locks and locks registered after the
+ * pool has run out are not profiled.
+ *
+ * lockprof_print lists the records sorted by total wait. It is
+ * called at shutdown.
+ *
+ * @{
+ */
+
+/* The record pool, allocated in order */
+static lockprof_t lockprof_records[CONFIG_LOCK_PROFILE_RECORDS];
+
+/* Number of records in use, protected by lockprof_slock */
+static int lockprof_count;
+static spinlock_t lockprof_slock;
+
+/**
+ * Initializes the profiler. Must be called before any lock is named.
+ */
+void lockprof_init(void)
+{
+    spinlock_reset(&lockprof_slock);
+    lockprof_count = 0;
+}
+
+/**
+ * Returns the record for the given name, allocating it if this is
+ * the first lock with the name.
+ *
+ * @param name Name of the lock, must stay in memory
+ *
+ * @return The record, NULL if the pool is exhausted
+ */
+lockprof_t *lockprof_register(const char *name)
+{
+    interrupt_status_t intr_status;
+    lockprof_t *prof = NULL;
+    int i;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&lockprof_slock);
+
+    for (i=0; i<lockprof_count; i++) {
+	if (stringcmp(lockprof_records[i].name, name) == 0) {
+	    prof = &lockprof_records[i];
+	    break;
+	}
+    }
+
+    if (prof == NULL && lockprof_count < CONFIG_LOCK_PROFILE_RECORDS) {
+	prof = &lockprof_records[lockprof_count];
+	memoryset(prof, 0, sizeof(lockprof_t));
+	spinlock_reset(&prof->slock);
+	prof->name = name;
+	lockprof_count++;
+    }
+
+    spinlock_release(&lockprof_slock);
+    _interrupt_set_state(intr_status);
+
+    return prof;
+}
+
+/**
+ * Accounts a wait to the site. If the site is not yet known, it
+ * replaces the known site with the shortest total wait.
+ *
+ * @param prof The record, locked
+ * @param site Return address of the acquire call
+ * @param wait Time waited in CPU cycles
+ */
+static void lockprof_account_site(lockprof_t *prof, uint32_t site,
+				  uint32_t wait)
+{
+    lockprof_site_t *entry = &prof->sites[0];
+    int i;
+
+    for (i=0; i<CONFIG_LOCK_PROFILE_SITES; i++) {
+	if (prof->sites[i].pc == site) {
+	    entry = &prof->sites[i];
+	    break;
+	}
+	if (prof->sites[i].wait < entry->wait)
+	    entry = &prof->sites[i];
+    }
+
+    if (entry->pc != site) {
+	entry->pc    = site;
+	entry->count = 0;
+	entry->wait  = 0;
+    }
+    entry->count++;
+    entry->wait += wait;
+}
+
+/**
+ * Accounts one acquisition of a lock.
+ *
+ * @param prof The record of the lock, NULL if the lock is not named
+ * @param contended Nonzero if the acquisition had to wait
+ * @param wait Time taken by the acquisition in CPU cycles
+ * @param site Return address of the acquire call
+ */
+void lockprof_account(lockprof_t *prof, int contended, uint32_t wait,
+		      uint32_t site)
+{
+    interrupt_status_t intr_status;
+
+    if (prof == NULL)
+	return;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&prof->slock);
+
+    prof->acquisitions++;
+    if (contended) {
+	prof->contended++;
+	prof->total_wait += wait;
+	if (wait > prof->max_wait)
+	    prof->max_wait = wait;
+	lockprof_account_site(prof, site, wait);
+    }
+
+    spinlock_release(&prof->slock);
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Prints the records which have been acquired at least once, sorted
+ * by total wait, each followed by its waiting sites. The records are
+ * read without locking.
+ */
+void lockprof_print(void)
+{
+    lockprof_t *sorted[CONFIG_LOCK_PROFILE_RECORDS];
+    lockprof_t *prof;
+    lockprof_site_t *site;
+    int count = 0;
+    int i, j;
+
+    /* insertion sort, longest total wait first */
+    for (i=0; i<lockprof_count; i++) {
+	prof = &lockprof_records[i];
+	if (prof->acquisitions == 0)
+	    continue;
+	for (j=count; j>0 && sorted[j-1]->total_wait < prof->total_wait; j--)
+	    sorted[j] = sorted[j-1];
+	sorted[j] = prof;
+	count++;
+    }
+
+    kprintf("Lock contention profile (times in cycles):\n");
+    for (i=0; i<count; i++) {
+	prof = sorted[i];
+	kprintf("%s: acquisitions %u, contended %u, "
+		"total wait %u, max wait %u\n", prof->name,
+		prof->acquisitions, prof->contended,
+		prof->total_wait, prof->max_wait);
+	for (j=0; j<CONFIG_LOCK_PROFILE_SITES; j++) {
+	    site = &prof->sites[j];
+	    if (site->pc == 0)
+		continue;
+	    kprintf("    site 0x%.8x: waits %u, total wait %u\n",
+		    site->pc, site->count, site->wait);
+	}
+    }
+}
+
+/** @} */
+
+#endif /* CONFIG_LOCK_PROFILE */
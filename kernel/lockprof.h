@@ -0,0 +1,97 @@
+/*
+ * Lock contention profiler.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef BUENOS_KERNEL_LOCKPROF_H
+#define BUENOS_KERNEL_LOCKPROF_H
+
+#include "kernel/config.h"
+#include "lib/types.h"
+
+#if CONFIG_LOCK_PROFILE
+
+#include "kernel/spinlock.h"
+#include "drivers/timer.h"
+
+/* A code location which has waited for a lock */
+typedef struct {
+    /* return address of the acquire call, 0 if the entry is unused */
+    uint32_t pc;
+    /* number of contended acquisitions from this location */
+    uint32_t count;
+    /* total time waited from this location, in CPU cycles */
+    uint32_t wait;
+} lockprof_site_t;
+
+/* Contention record shared by the locks registered with one name */
+typedef struct {
+    /* name given at registration, NULL if the record is unused */
+    const char *name;
+    /* protects the fields below */
+    spinlock_t slock;
+    /* number of acquisitions */
+    uint32_t acquisitions;
+    /* number of acquisitions which had to wait */
+    uint32_t contended;
+    /* total and longest wait of the contended acquisitions, cycles */
+    uint32_t total_wait;
+    uint32_t max_wait;
+    /* the locations which have waited longest */
+    lockprof_site_t sites[CONFIG_LOCK_PROFILE_SITES];
+} lockprof_t;
+
+void lockprof_init(void);
+lockprof_t *lockprof_register(const char *name);
+void lockprof_account(lockprof_t *prof, int contended, uint32_t wait,
+		      uint32_t site);
+void lockprof_print(void);
+
+/* Evaluates acquire, which must be nonzero if the acquisition had to
+   wait, and accounts the acquisition to prof. Used in the acquire
+   functions of the locks, so the site is their caller. */
+#define LOCKPROF_ACQUIRE(prof, acquire)					\
+    do {								\
+	uint32_t _lockprof_start = timer_get_ticks();			\
+	int _lockprof_contended = (acquire);				\
+	lockprof_account((prof), _lockprof_contended,			\
+			 timer_get_ticks() - _lockprof_start,		\
+			 (uint32_t)__builtin_return_address(0));	\
+    } while (0)
+
+#else
+
+#define LOCKPROF_ACQUIRE(prof, acquire) ((void)(acquire))
+
+#endif /* CONFIG_LOCK_PROFILE */
+
+#endif /* BUENOS_KERNEL_LOCKPROF_H */
@@ -5,8 +5,9 @@ MODULE := kernel
 
 
 FILES := cswitch.S panic.c kmalloc.c interrupt.c thread.c \
-         scheduler.c _interrupt.S _spinlock.S idle.S sleepq.c semaphore.c \
-         exception.c halt.c
+         scheduler.c _interrupt.S _spinlock.S _atomic.S spinlock.c idle.S sleepq.c \
+         semaphore.c completion.c lock_cond.c rwlock.c exception.c halt.c ipi.c \
+         trace.c bench.c timeout.c lockprof.c rcu.c slab.c
 
 SRC += $(patsubst %, $(MODULE)/%, $(FILES))
 
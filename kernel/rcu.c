@@ -0,0 +1,133 @@
+/*
+ * Read-copy-update.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "kernel/rcu.h"
+#include "kernel/thread.h"
+#include "kernel/config.h"
+
+/** @name Read-copy-update
+ *
+ * Read-copy-update lets readers look up shared data without taking
+ * any lock. A reader brackets its accesses with rcu_read_lock and
+ * rcu_read_unlock, which only disable and restore interrupts. An
+ * updater publishes new objects with rcu_assign_pointer. To remove
+ * an object it first unpublishes it, then calls rcu_synchronize to
+ * wait until no reader can still be using it, and only then frees
+ * or reuses it.
+ *
+ * Since readers run with interrupts disabled, a CPU which passes
+ * through the scheduler cannot be inside a read-side critical
+ * section. Every CPU counts its passes through the scheduler, and
+ * rcu_synchronize waits until each CPU which was running a thread
+ * when it was called has advanced its count or is idle. This period
+ * is called a grace period. The calling CPU itself and CPUs running
+ * the idle thread need not be waited for, since they are not
+ * reading.
+ *
+ * Updaters must serialize among themselves by other means.
+ *
+ * @{
+ */
+
+/* Currently running thread on each CPU, from scheduler.c */
+extern TID_t scheduler_current_thread[CONFIG_MAX_CPUS];
+
+/* Number of passes through the scheduler of each CPU */
+static volatile uint32_t rcu_quiescent[CONFIG_MAX_CPUS];
+
+/**
+ * Initializes the read-copy-update counters.
+ */
+void rcu_init(void)
+{
+    int i;
+
+    for (i=0; i<CONFIG_MAX_CPUS; i++)
+	rcu_quiescent[i] = 0;
+}
+
+/**
+ * Records that the calling CPU is not in a read-side critical
+ * section. Called by the scheduler with interrupts disabled.
+ */
+void rcu_quiescent_state(void)
+{
+    rcu_quiescent[_interrupt_getcpu()]++;
+}
+
+/**
+ * Waits for a grace period: returns when every read-side critical
+ * section which was running at the time of the call has ended.
+ * Objects unpublished before the call can be freed afterwards. Must
+ * be called by a thread, since it sleeps.
+ */
+void rcu_synchronize(void)
+{
+    interrupt_status_t intr_status;
+    uint32_t snapshot[CONFIG_MAX_CPUS];
+    int waiting[CONFIG_MAX_CPUS];
+    int cpu, this_cpu, pending;
+
+    /* make the unpublishing visible before looking at the CPUs */
+    _memory_barrier();
+
+    intr_status = _interrupt_disable();
+    this_cpu = _interrupt_getcpu();
+    for (cpu=0; cpu<CONFIG_MAX_CPUS; cpu++) {
+	snapshot[cpu] = rcu_quiescent[cpu];
+	waiting[cpu] = (cpu != this_cpu 
+			&& scheduler_current_thread[cpu] != IDLE_THREAD_TID);
+    }
+    _interrupt_set_state(intr_status);
+
+    for (;;) {
+	pending = 0;
+	for (cpu=0; cpu<CONFIG_MAX_CPUS; cpu++) {
+	    if (!waiting[cpu])
+		continue;
+	    if (rcu_quiescent[cpu] != snapshot[cpu]
+		|| scheduler_current_thread[cpu] == IDLE_THREAD_TID)
+		waiting[cpu] = 0;
+	    else
+		pending = 1;
+	}
+	if (!pending)
+	    break;
+
+	/* The other CPUs switch threads at least once per timeslice */
+	thread_sleep(1);
+    }
+}
+
+/** @} */
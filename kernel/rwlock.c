@@ -0,0 +1,218 @@
+/*
+ * Reader-writer locks.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "kernel/rwlock.h"
+#include "kernel/sleepq.h"
+#include "kernel/thread.h"
+#include "kernel/interrupt.h"
+#include "kernel/assert.h"
+
+/** @name Reader-writer locks
+ *
+ * A reader-writer lock may be held by any number of readers at the
+ * same time, or by one writer. Threads which cannot get the lock
+ * sleep until it is released. Writers are preferred: a new reader
+ * waits if any writer is waiting, so a stream of readers cannot
+ * starve the writers. When a writer releases the lock, the next
+ * waiting writer gets it; only if there are none are all the waiting
+ * readers woken.
+ *
+ * Readers sleep on the waiting_readers field and writers on the
+ * waiting_writers field of the lock, so each kind can be woken
+ * separately. A woken thread checks the lock again and may have to
+ * go back to sleep.
+ *
+ * Reader-writer locks must not be used in interrupt handlers.
+ *
+ * @{
+ */
+
+/**
+ * Initializes the lock as free. Must not be called on a lock which
+ * may be in use.
+ *
+ * @param rwlock The lock to initialize
+ */
+void rwlock_reset(rwlock_t *rwlock)
+{
+    spinlock_reset(&rwlock->slock);
+    rwlock->readers = 0;
+    rwlock->writer = 0;
+    rwlock->waiting_readers = 0;
+    rwlock->waiting_writers = 0;
+#if CONFIG_LOCK_PROFILE
+    rwlock->prof = NULL;
+#endif
+}
+
+/**
+ * Gives the lock a name under which its contention is profiled with
+ * CONFIG_LOCK_PROFILE. Reads and writes are profiled together. Does
+ * nothing if profiling is not enabled.
+ *
+ * @param rwlock The lock
+ * @param name Name of the lock, must stay in memory
+ */
+void rwlock_set_name(rwlock_t *rwlock, const char *name)
+{
+#if CONFIG_LOCK_PROFILE
+    rwlock->prof = lockprof_register(name);
+#else
+    rwlock = rwlock;
+    name = name;
+#endif
+}
+
+/* Acquires the lock for reading. Returns nonzero if it had to wait. */
+static int rwlock_read_take(rwlock_t *rwlock)
+{
+    interrupt_status_t intr_status;
+    int contended = 0;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&rwlock->slock);
+
+    while (rwlock->writer || rwlock->waiting_writers > 0) {
+	contended = 1;
+	rwlock->waiting_readers++;
+	sleepq_add(&rwlock->waiting_readers);
+	spinlock_release(&rwlock->slock);
+	thread_switch();
+	spinlock_acquire(&rwlock->slock);
+	rwlock->waiting_readers--;
+    }
+    rwlock->readers++;
+
+    spinlock_release(&rwlock->slock);
+    _interrupt_set_state(intr_status);
+
+    return contended;
+}
+
+/**
+ * Acquires the lock for reading. Sleeps while a writer holds the
+ * lock or is waiting for it.
+ *
+ * @param rwlock The lock to acquire
+ */
+void rwlock_read_acquire(rwlock_t *rwlock)
+{
+    LOCKPROF_ACQUIRE(rwlock->prof, rwlock_read_take(rwlock));
+}
+
+/**
+ * Releases a read lock. The last reader out wakes a waiting writer.
+ *
+ * @param rwlock The lock to release
+ */
+void rwlock_read_release(rwlock_t *rwlock)
+{
+    interrupt_status_t intr_status;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&rwlock->slock);
+
+    KERNEL_ASSERT(rwlock->readers > 0);
+
+    rwlock->readers--;
+    if (rwlock->readers == 0 && rwlock->waiting_writers > 0)
+	sleepq_wake(&rwlock->waiting_writers);
+
+    spinlock_release(&rwlock->slock);
+    _interrupt_set_state(intr_status);
+}
+
+/* Acquires the lock for writing. Returns nonzero if it had to wait. */
+static int rwlock_write_take(rwlock_t *rwlock)
+{
+    interrupt_status_t intr_status;
+    int contended = 0;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&rwlock->slock);
+
+    while (rwlock->writer || rwlock->readers > 0) {
+	contended = 1;
+	rwlock->waiting_writers++;
+	sleepq_add(&rwlock->waiting_writers);
+	spinlock_release(&rwlock->slock);
+	thread_switch();
+	spinlock_acquire(&rwlock->slock);
+	rwlock->waiting_writers--;
+    }
+    rwlock->writer = 1;
+
+    spinlock_release(&rwlock->slock);
+    _interrupt_set_state(intr_status);
+
+    return contended;
+}
+
+/**
+ * Acquires the lock for writing. Sleeps while the lock is held by
+ * readers or another writer.
+ *
+ * @param rwlock The lock to acquire
+ */
+void rwlock_write_acquire(rwlock_t *rwlock)
+{
+    LOCKPROF_ACQUIRE(rwlock->prof, rwlock_write_take(rwlock));
+}
+
+/**
+ * Releases a write lock. Wakes the next waiting writer, or if there
+ * is none, all waiting readers.
+ *
+ * @param rwlock The lock to release
+ */
+void rwlock_write_release(rwlock_t *rwlock)
+{
+    interrupt_status_t intr_status;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&rwlock->slock);
+
+    KERNEL_ASSERT(rwlock->writer);
+
+    rwlock->writer = 0;
+    if (rwlock->waiting_writers > 0)
+	sleepq_wake(&rwlock->waiting_writers);
+    else if (rwlock->waiting_readers > 0)
+	sleepq_wake_all(&rwlock->waiting_readers);
+
+    spinlock_release(&rwlock->slock);
+    _interrupt_set_state(intr_status);
+}
+
+/** @} */
@@ -0,0 +1,64 @@
+/*
+ * Reader-writer locks.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef BUENOS_KERNEL_RWLOCK_H
+#define BUENOS_KERNEL_RWLOCK_H
+
+#include "kernel/spinlock.h"
+#include "kernel/lockprof.h"
+
+typedef struct {
+    /* protects the fields below */
+    spinlock_t slock;
+    /* number of readers holding the lock */
+    int readers;
+    /* nonzero if a writer holds the lock */
+    int writer;
+    /* number of readers and writers sleeping on the lock */
+    int waiting_readers;
+    int waiting_writers;
+#if CONFIG_LOCK_PROFILE
+    /* contention record, NULL if the lock is not named */
+    lockprof_t *prof;
+#endif
+} rwlock_t;
+
+void rwlock_reset(rwlock_t *rwlock);
+void rwlock_set_name(rwlock_t *rwlock, const char *name);
+void rwlock_read_acquire(rwlock_t *rwlock);
+void rwlock_read_release(rwlock_t *rwlock);
+void rwlock_write_acquire(rwlock_t *rwlock);
+void rwlock_write_release(rwlock_t *rwlock);
+
+#endif /* BUENOS_KERNEL_RWLOCK_H */
@@ -33,7 +33,6 @@
  * $Id: scheduler.c,v 1.14 2007/02/25 15:16:29 jaatroko Exp $
  *
  */
-
 #include "kernel/thread.h"
 #include "kernel/spinlock.h"
 #include "kernel/assert.h"
@@ -42,39 +41,159 @@
 #include "lib/libc.h"
 #include "kernel/config.h"
 #include "drivers/timer.h"
+#include "kernel/ipi.h"
+#include "kernel/trace.h"
+#include "kernel/timeout.h"
+#include "kernel/rcu.h"
 
 /** @name Scheduler
  *
- * This module implements simple round robin scheduler.
+ * This module implements a multi-level feedback queue scheduler.
+ * There are CONFIG_SCHEDULER_LEVELS priority levels, level 0 being
+ * the highest, and threads of the same level are circulated in round
+ * robin manner. The timeslice doubles on each lower level.
+ *
+ * A new thread starts on the highest level. A thread which uses up
+ * the timeslice of its level is demoted one level, and a thread which
+ * goes to sleep before using half of it is promoted one level, so
+ * threads that block often end up on the high levels with short
+ * slices and CPU bound threads sink to the bottom. To prevent
+ * starvation, every CONFIG_SCHEDULER_BOOST_INTERVAL cycles all
+ * threads are boosted back to the highest level.
+ *
+ * Each CPU has its own ready to run queue protected by its own
+ * spinlock, so that scheduling on one CPU does not contend with the
+ * others. A CPU whose queue is empty steals half of the threads from
+ * the busiest queue before falling back to the idle thread.
+ *
+ * A CPU which queues new work sends a reschedule IPI to one idle
+ * CPU, which then steals the work without waiting for its next timer
+ * tick. With CONFIG_SCHEDULER_TICKLESS_IDLE the timer tick is
+ * stopped altogether on a CPU running the idle thread, and the CPU
+ * sleeps in the WAIT instruction until an interrupt or an IPI. While
+ * timeouts are pending (see kernel/timeout.c) the timer is instead
+ * set to interrupt at the next timeout tick, both on idle and busy
+ * CPUs.
  *
  */
 
-/* Import thread table and its lock from thread.c */
-extern spinlock_t thread_table_slock;
-extern thread_table_t thread_table[CONFIG_MAX_THREADS];
+/* Import thread table from thread.c */
+extern thread_table_t *thread_table;
+extern int thread_table_size;
 
 /** Currently running thread on each CPU */
 TID_t scheduler_current_thread[CONFIG_MAX_CPUS];
 
-/** List of threads ready to be run. */
-static struct {
-    TID_t head; /* the first thread in ready to run queue, negative if none */
-    TID_t tail; /* the last thread in ready to run queue, negative if none */
-} scheduler_ready_to_run = {-1, -1};
+/** A list of ready threads on one priority level. */
+typedef struct {
+    TID_t head; /* the first thread in the list, negative if none */
+    TID_t tail; /* the last thread in the list, negative if none */
+} scheduler_list_t;
+
+/** Per-CPU queues of threads ready to be run. */
+typedef struct {
+    spinlock_t slock; /* must be held when manipulating this queue */
+    scheduler_list_t level[CONFIG_SCHEDULER_LEVELS];
+    int count;  /* number of threads in all levels of the queue */
+} scheduler_queue_t;
+
+static scheduler_queue_t scheduler_ready_to_run[CONFIG_MAX_CPUS];
+
+/** CP0 cycle count when the current timeslice of each CPU started */
+static uint32_t scheduler_slice_start[CONFIG_MAX_CPUS];
+
+/** CP0 cycle count of the last priority boost of each CPU */
+static uint32_t scheduler_last_boost[CONFIG_MAX_CPUS];
+
+/* Length of the timeslice on the given priority level */
+#define SCHEDULER_TIMESLICE(level) (CONFIG_SCHEDULER_TIMESLICE << (level))
 
 /**
- * Initializes the scheduler current thread table to 0 for each processor.
+ * Initializes the scheduler current thread table to 0 for each
+ * processor and empties the ready to run queues.
  */
 void scheduler_init(void) {
-    int i;
-    for (i=0; i<CONFIG_MAX_CPUS; i++)
+    int i, j;
+    for (i=0; i<CONFIG_MAX_CPUS; i++) {
 	scheduler_current_thread[i] = 0;
+	spinlock_reset(&scheduler_ready_to_run[i].slock);
+	spinlock_stats_register(&scheduler_ready_to_run[i].slock);
+	for (j=0; j<CONFIG_SCHEDULER_LEVELS; j++) {
+	    scheduler_ready_to_run[i].level[j].head = -1;
+	    scheduler_ready_to_run[i].level[j].tail = -1;
+	}
+	scheduler_ready_to_run[i].count = 0;
+	scheduler_slice_start[i] = 0;
+	scheduler_last_boost[i] = 0;
+    }
+}
+
+/**
+ * Wakes up CPUs running the idle thread, if there are any, with a
+ * reschedule IPI. The woken CPUs run the scheduler and steal the
+ * work queued by the calling CPU. Without this an idle CPU would
+ * notice the work only at its next timer tick, or in tickless mode
+ * whenever some device interrupt happened to arrive.
+ *
+ * @param this_cpu The calling CPU, which is never woken.
+ * @param count The maximum number of CPUs to wake.
+ */
+static void scheduler_kick_idle(int this_cpu, int count)
+{
+    int i;
+
+    for (i=0; i<CONFIG_MAX_CPUS && count > 0; i++) {
+	if (i != this_cpu 
+	    && scheduler_current_thread[i] == IDLE_THREAD_TID) {
+	    ipi_reschedule(i);
+	    count--;
+	}
+    }
+}
+
+/**
+ * Appends given thread to the given ready to run queue on the level
+ * of the thread's priority. The queue spinlock must be held and
+ * interrupts disabled.
+ *
+ * @param queue Queue to append to
+ * @param t thread to add to the queue
+ */
+static void scheduler_queue_append(scheduler_queue_t *queue, TID_t t)
+{
+    scheduler_list_t *list;
+
+    KERNEL_ASSERT(thread_table[t].priority < CONFIG_SCHEDULER_LEVELS);
+
+    list = &queue->level[thread_table[t].priority];
+
+    thread_table[t].next = -1;
+
+    if (list->tail < 0) {
+	/* list was empty */
+	list->head = t;
+    } else {
+	/* list was not empty */
+	thread_table[list->tail].next = t;
+    }
+    list->tail = t;
+    queue->count++;
+
+    trace_thread_ready(t);
 }
 
 /**
- * Adds given thread to scheduler's ready to run list. Doesn't do 
- * any synchronization, it is assumed that spinlock to the thread table
- * is held and interrups are disabled when calling this function.
+ * Adds given thread to the ready to run list of the calling CPU.
+ * Only the queue spinlock is taken here. It is assumed that the
+ * thread has already been marked THREAD_READY by the caller and
+ * that interrupts are disabled when calling this function. The
+ * spinlock of the thread table entry may be held (it is acquired
+ * before any queue spinlock).
+ *
+ * If the added thread has a higher priority than the thread running
+ * on this CPU, a reschedule is requested so that it does not have to
+ * wait for the end of the running thread's timeslice. An idle CPU,
+ * if any, is also woken up to take the thread.
  * 
  * @param t thread to add to ready list
  *
@@ -82,66 +201,239 @@ void scheduler_init(void) {
 
 void scheduler_add_to_ready_list(TID_t t)
 {
+    scheduler_queue_t *queue;
+    TID_t current;
+    int this_cpu;
+
     /* Idle thread should never go into the ready list */
     KERNEL_ASSERT(t != IDLE_THREAD_TID);
 
     /* Sanity check */
-    KERNEL_ASSERT(t >= 0 && t < CONFIG_MAX_THREADS);
+    KERNEL_ASSERT(t >= 0 && t < thread_table_size);
 
-    if (scheduler_ready_to_run.tail < 0) {
-	/* ready queue was empty */
-	scheduler_ready_to_run.head = t;
-	scheduler_ready_to_run.tail = t;
-	thread_table[t].next = -1;
-    } else {
-	/* ready queue was not empty */
-	thread_table[scheduler_ready_to_run.tail].next = t;
-	thread_table[t].next = -1;
-	scheduler_ready_to_run.tail = t;
+    this_cpu = _interrupt_getcpu();
+    queue = &scheduler_ready_to_run[this_cpu];
+
+    spinlock_acquire(&queue->slock);
+    scheduler_queue_append(queue, t);
+    spinlock_release(&queue->slock);
+
+    current = scheduler_current_thread[this_cpu];
+    if (current != IDLE_THREAD_TID &&
+	thread_table[t].priority < thread_table[current].priority)
+	_interrupt_generate_sw0();
+
+    scheduler_kick_idle(this_cpu, 1);
+}
+
+/**
+ * Adds a list of threads to the ready to run list of the calling
+ * CPU, taking the queue spinlock only once. The threads are chained
+ * through their next fields, the last one having a negative next.
+ * Otherwise the same as scheduler_add_to_ready_list: the threads
+ * must already be marked THREAD_READY and interrupts disabled.
+ *
+ * @param first The first thread in the list
+ */
+
+void scheduler_add_list_to_ready_list(TID_t first)
+{
+    scheduler_queue_t *queue;
+    TID_t t, next, current;
+    uint32_t best = CONFIG_SCHEDULER_LEVELS;
+    int this_cpu, count = 0;
+
+    this_cpu = _interrupt_getcpu();
+    queue = &scheduler_ready_to_run[this_cpu];
+
+    spinlock_acquire(&queue->slock);
+    for (t = first; t >= 0; t = next) {
+	KERNEL_ASSERT(t != IDLE_THREAD_TID && t < thread_table_size);
+	next = thread_table[t].next;
+	best = MIN(best, thread_table[t].priority);
+	scheduler_queue_append(queue, t);
+	count++;
     }
+    spinlock_release(&queue->slock);
+
+    current = scheduler_current_thread[this_cpu];
+    if (current != IDLE_THREAD_TID && best < thread_table[current].priority)
+	_interrupt_generate_sw0();
+
+    scheduler_kick_idle(this_cpu, count);
 }
 
 /**
- * Removes the first thread from the ready to run list and returns it.
- * if the list was empty, returns the idle thread (TID 0). It is assumed
- * that interrupts are disabled and thread table spinlock is held when
- * this function is called.
+ * Removes the first thread of the highest nonempty priority level
+ * from the given ready to run queue and returns it. Returns negative
+ * if the queue was empty. It is assumed that interrupts are disabled
+ * when this function is called.
  *
- * @return The removed thread.
+ * @param queue The queue to remove the thread from
+ *
+ * @return The removed thread, negative if none.
  *
  */
 
-static TID_t scheduler_remove_first_ready(void)
+static TID_t scheduler_remove_first_ready(scheduler_queue_t *queue)
 {
+    scheduler_list_t *list;
+    TID_t t = -1;
+    int i;
+
+    spinlock_acquire(&queue->slock);
+
+    for (i=0; i<CONFIG_SCHEDULER_LEVELS; i++) {
+	list = &queue->level[i];
+	t = list->head;
+
+	/* Idle thread should never be on the ready list. */
+	KERNEL_ASSERT(t != IDLE_THREAD_TID);
+
+	if(t >= 0) {
+	    /* Threads in ready queue should be in state Ready */
+	    KERNEL_ASSERT(thread_table[t].state == THREAD_READY);
+	    if(list->tail == t) {
+		list->tail = -1;
+	    }
+	    list->head = thread_table[t].next;
+	    queue->count--;
+	    break;
+	}
+    }
+
+    spinlock_release(&queue->slock);
+
+    return t;
+}
+
+/**
+ * Steals half of the threads from the busiest ready to run queue
+ * of another CPU and moves them to the queue of the calling
+ * CPU. Threads are taken starting from the highest priority level.
+ * The victim queue is locked only while the stolen threads are
+ * detached from it, so no two queue locks are ever held at the same
+ * time. It is assumed that interrupts are disabled.
+ *
+ * @param this_cpu The CPU which is stealing
+ *
+ * @return Nonzero if any threads were stolen.
+ */
+
+static int scheduler_steal(int this_cpu)
+{
+    scheduler_queue_t *victim = NULL;
+    scheduler_queue_t *own;
+    scheduler_list_t stolen[CONFIG_SCHEDULER_LEVELS];
     TID_t t;
+    int i, n, total, busiest = 0;
+
+    /* The counts are read without locking, this is only a hint. */
+    for (i=0; i<CONFIG_MAX_CPUS; i++) {
+	if (i != this_cpu && scheduler_ready_to_run[i].count > busiest) {
+	    busiest = scheduler_ready_to_run[i].count;
+	    victim = &scheduler_ready_to_run[i];
+	}
+    }
 
-    t = scheduler_ready_to_run.head;
+    if (victim == NULL)
+	return 0;
 
-    /* Idle thread should never be on the ready list. */
-    KERNEL_ASSERT(t != IDLE_THREAD_TID);
+    spinlock_acquire(&victim->slock);
+
+    /* Take the first half (rounded up) of the victim's queue */
+    total = n = (victim->count + 1) / 2;
+
+    for (i=0; i<CONFIG_SCHEDULER_LEVELS; i++) {
+	stolen[i].head = stolen[i].tail = -1;
 
-    if(t >= 0) {
-        /* Threads in ready queue should be in state Ready */
-        KERNEL_ASSERT(thread_table[t].state == THREAD_READY);
-	if(scheduler_ready_to_run.tail == t) {
-	    scheduler_ready_to_run.tail = -1;
+	if (n == 0 || victim->level[i].head < 0)
+	    continue;
+
+	stolen[i].head = t = victim->level[i].head;
+	n--;
+	while (n > 0 && thread_table[t].next >= 0) {
+	    t = thread_table[t].next;
+	    n--;
 	}
-	scheduler_ready_to_run.head =
-	    thread_table[scheduler_ready_to_run.head].next;
+	stolen[i].tail = t;
 
+	victim->level[i].head = thread_table[t].next;
+	if (victim->level[i].head < 0)
+	    victim->level[i].tail = -1;
+	thread_table[t].next = -1;
     }
+    victim->count -= total;
 
-    if(t < 0) {
-	return IDLE_THREAD_TID;
-    } else {
-	return t;
+    spinlock_release(&victim->slock);
+
+    if (total == 0) {
+	/* Somebody emptied the queue after we looked */
+	return 0;
+    }
+
+    own = &scheduler_ready_to_run[this_cpu];
+
+    spinlock_acquire(&own->slock);
+    for (i=0; i<CONFIG_SCHEDULER_LEVELS; i++) {
+	if (stolen[i].head < 0)
+	    continue;
+	if (own->level[i].tail < 0) {
+	    own->level[i].head = stolen[i].head;
+	} else {
+	    thread_table[own->level[i].tail].next = stolen[i].head;
+	}
+	own->level[i].tail = stolen[i].tail;
     }
+    own->count += total;
+    spinlock_release(&own->slock);
+
+    return 1;
+}
+
+/**
+ * Moves every thread in the ready to run queue of the given CPU to
+ * the highest priority level. The order of the threads is preserved
+ * level by level. It is assumed that interrupts are disabled.
+ *
+ * @param this_cpu The CPU whose queue is boosted
+ */
+
+static void scheduler_boost(int this_cpu)
+{
+    scheduler_queue_t *queue = &scheduler_ready_to_run[this_cpu];
+    scheduler_list_t *top = &queue->level[0];
+    TID_t t;
+    int i;
+
+    spinlock_acquire(&queue->slock);
+
+    for (i=1; i<CONFIG_SCHEDULER_LEVELS; i++) {
+	if (queue->level[i].head < 0)
+	    continue;
+
+	for (t = queue->level[i].head; t >= 0; t = thread_table[t].next) {
+	    thread_table[t].priority = 0;
+	    thread_table[t].runtime  = 0;
+	}
+
+	if (top->tail < 0) {
+	    top->head = queue->level[i].head;
+	} else {
+	    thread_table[top->tail].next = queue->level[i].head;
+	}
+	top->tail = queue->level[i].tail;
+	queue->level[i].head = queue->level[i].tail = -1;
+    }
+
+    spinlock_release(&queue->slock);
 }
 
 /**
  * Adds given thread to scheduler's ready to run list. This function
  * handles syncronization and can be called from anywhere where
- * needed. Must not be called if thread table spinlock is already held.
+ * needed. Must not be called if the spinlock of the thread table
+ * entry is already held.
  *
  * @param t Thread to add. The thread must not already be on the ready
  * list or running.
@@ -154,12 +446,12 @@ void scheduler_add_ready(TID_t t)
     
     intr_status = _interrupt_disable();
 
-    spinlock_acquire(&thread_table_slock);
+    thread_lock(t);
 
-    scheduler_add_to_ready_list(t);
     thread_table[t].state = THREAD_READY;
+    scheduler_add_to_ready_list(t);
 
-    spinlock_release(&thread_table_slock);
+    thread_unlock(t);
 
     _interrupt_set_state(intr_status);
 }
@@ -168,51 +460,140 @@ void scheduler_add_ready(TID_t t)
 /**
  * Select next thread for running. Removes the currently running
  * thread running on this CPU and selects new running thread.
- * Circulates threads in round robin manner. Must be called only from
- * interrupt/exception handlers and code assumes that interrupts are
- * disabled (which is the case in interrupt handlers).
+ * Must be called only from interrupt/exception handlers and code
+ * assumes that interrupts are disabled (which is the case in
+ * interrupt handlers).
  *
- * Scheduler also handles thread table row freeing when thread is
- * DYING and removes threads wishing to sleep (sleeps_on != 0) from
- * ready status and places them SLEEPING. Syncronizes access to thread
- * table by acquiring the thread table spinlock.
+ * The time the current thread has run is charged to it, and its
+ * priority is lowered if it has used up the timeslice of its level
+ * or raised if it goes to sleep early.
+ *
+ * The decision is recorded in the scheduler trace (see
+ * kernel/trace.c).
+ *
+ * Scheduler also frees the stack and the thread table row of a
+ * DYING thread and removes threads wishing to sleep (sleeps_on != 0) from
+ * ready status and places them SLEEPING. The spinlock of the current
+ * thread's entry is held only while its state is changed; the ready
+ * to run queues are protected by their own spinlocks.
+ *
+ * The next thread is taken from the highest nonempty priority level
+ * of this CPU's queue. If the queue is empty, half of the busiest
+ * queue of the other CPUs is stolen, and only if that fails too the
+ * idle thread is run.
  *
  * After selecting new thread for running the scheduler will reset the
  * CP0 timer to cause timer interrupt after thread's timeslice is
- * over.
+ * over. In tickless mode the timer is stopped instead if the idle
+ * thread was selected.
  *
  */
 
 void scheduler_schedule(void)
 {
-    TID_t t;
+    TID_t t, prev;
     thread_table_t *current_thread;
     int this_cpu;
+    int requeue = 0, dead = 0;
+    uint32_t now, slice, next_tick, reason;
 
     this_cpu = _interrupt_getcpu();
+    now = timer_get_ticks();
+
+    /* The interrupted or yielding thread is not reading */
+    rcu_quiescent_state();
+
+    prev = scheduler_current_thread[this_cpu];
+    current_thread = &(thread_table[prev]);
+
+    if (prev != IDLE_THREAD_TID) {
+	current_thread->runtime += now - scheduler_slice_start[this_cpu];
+	slice = SCHEDULER_TIMESLICE(current_thread->priority);
+
+	if (current_thread->runtime >= slice) {
+	    /* Used up the whole timeslice: demote */
+	    if (current_thread->priority < CONFIG_SCHEDULER_LEVELS - 1)
+		current_thread->priority++;
+	    current_thread->runtime = 0;
+	} else if (current_thread->sleeps_on != 0 
+		   && current_thread->runtime < slice / 2) {
+	    /* Blocking early: promote */
+	    if (current_thread->priority > 0)
+		current_thread->priority--;
+	    current_thread->runtime = 0;
+	}
+    }
 
-    spinlock_acquire(&thread_table_slock);
-
-    current_thread = &(thread_table[scheduler_current_thread[this_cpu]]);
+    thread_lock(prev);
 
     if(current_thread->state == THREAD_DYING) {
-	current_thread->state = THREAD_FREE;
+	dead = 1;
+	reason = TRACE_SWITCH_EXIT;
     } else if(current_thread->sleeps_on != 0) {
 	current_thread->state = THREAD_SLEEPING;
+	reason = TRACE_SWITCH_SLEEP;
     } else {
-	if(scheduler_current_thread[this_cpu] != IDLE_THREAD_TID)
-	    scheduler_add_to_ready_list(scheduler_current_thread[this_cpu]);
 	current_thread->state = THREAD_READY;
+	requeue = (prev != IDLE_THREAD_TID);
+	reason = TRACE_SWITCH_PREEMPT;
     }
 
-    t = scheduler_remove_first_ready();
-    thread_table[t].state = THREAD_RUNNING;
+    thread_unlock(prev);
 
-    spinlock_release(&thread_table_slock);
+    if (now - scheduler_last_boost[this_cpu] 
+	>= CONFIG_SCHEDULER_BOOST_INTERVAL) {
+	scheduler_last_boost[this_cpu] = now;
+	scheduler_boost(this_cpu);
+	if (requeue) {
+	    current_thread->priority = 0;
+	    current_thread->runtime  = 0;
+	}
+    }
+
+    if (requeue) {
+	spinlock_acquire(&scheduler_ready_to_run[this_cpu].slock);
+	scheduler_queue_append(&scheduler_ready_to_run[this_cpu], prev);
+	spinlock_release(&scheduler_ready_to_run[this_cpu].slock);
+    }
+
+    t = scheduler_remove_first_ready(&scheduler_ready_to_run[this_cpu]);
+    if (t < 0 && scheduler_steal(this_cpu))
+	t = scheduler_remove_first_ready(&scheduler_ready_to_run[this_cpu]);
+    if (t < 0)
+	t = IDLE_THREAD_TID;
+
+    thread_table[t].state = THREAD_RUNNING;
 
     scheduler_current_thread[this_cpu] = t;
 
-    /* Schedule timer interrupt to occur after thread timeslice is spent */
-    timer_set_ticks(_get_rand(CONFIG_SCHEDULER_TIMESLICE) + 
-                    CONFIG_SCHEDULER_TIMESLICE / 2);
+    trace_switch(prev, t, reason);
+
+    if (dead)
+	thread_free_entry(prev);
+
+    /* While timeouts are pending the timer must interrupt at least
+       once per timeout tick */
+    next_tick = timeout_next_tick();
+
+#if CONFIG_SCHEDULER_TICKLESS_IDLE
+    if (t == IDLE_THREAD_TID) {
+	/* Nothing to do: sleep until an interrupt, a wakeup or the
+	   next timeout tick */
+	if (next_tick == 0)
+	    timer_stop();
+	else
+	    timer_set_ticks(next_tick);
+	return;
+    }
+#endif
+
+    /* Schedule timer interrupt to occur after thread timeslice is
+       spent. The slice is randomized around the nominal length of
+       the thread's priority level. */
+    slice = SCHEDULER_TIMESLICE(thread_table[t].priority);
+    slice = _get_rand(slice) + slice / 2;
+    if (next_tick != 0 && next_tick < slice)
+	slice = next_tick;
+    scheduler_slice_start[this_cpu] = timer_get_ticks();
+    timer_set_ticks(slice);
 }
@@ -37,44 +37,92 @@
 #include "kernel/interrupt.h"
 #include "kernel/semaphore.h"
 #include "kernel/sleepq.h"
+#include "kernel/timeout.h"
 #include "kernel/config.h"
 #include "kernel/assert.h"
+#include "kernel/slab.h"
 #include "lib/libc.h"
 
 /** @name Semaphores
  *
  * This module implements semaphores.
  *
+ * Semaphores are first taken from a free list filled from a small
+ * static table, which covers the semaphores created during boot.
+ * When the list is empty they are allocated from a slab cache, so
+ * the number of semaphores is limited only by memory. Destroyed
+ * semaphores go back to where they came from: boot semaphores to the
+ * free list for reuse, the others to the slab cache.
+ *
  * @{
  */
 
-/** Table containing all semaphores in the system */
-static semaphore_t semaphore_table[CONFIG_MAX_SEMAPHORES];
+/** Statically allocated semaphores used during boot */
+static semaphore_t semaphore_boot_table[CONFIG_BOOT_SEMAPHORES];
+
+/** List of unallocated semaphores */
+static semaphore_t *semaphore_free_list;
+
+/** Lock which must be held before accessing the semaphore_free_list */
+static spinlock_t semaphore_free_slock;
+
+/** Cache of the semaphores allocated after the boot semaphores */
+static kmem_cache_t *semaphore_cache;
+
+/* Nonzero if the semaphore is one of the static boot semaphores */
+#define SEMAPHORE_IS_BOOT(sem) \
+    ((sem) >= semaphore_boot_table \
+     && (sem) < semaphore_boot_table + CONFIG_BOOT_SEMAPHORES)
+
+/**
+ * Puts count semaphores starting at sems to the free list.
+ *
+ * @param sems Array of unused semaphores
+ * @param count Number of semaphores in the array
+ */
+static void semaphore_add_free(semaphore_t *sems, int count)
+{
+    interrupt_status_t intr_status;
+    int i;
+
+    for(i = 0; i < count - 1; i++) {
+        sems[i].creator = -1;
+        sems[i].next_free = &sems[i + 1];
+    }
+    sems[count - 1].creator = -1;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&semaphore_free_slock);
 
-/** Lock which must be held before accessing the semaphore_table */
-static spinlock_t semaphore_table_slock;
+    sems[count - 1].next_free = semaphore_free_list;
+    semaphore_free_list = sems;
+
+    spinlock_release(&semaphore_free_slock);
+    _interrupt_set_state(intr_status);
+}
 
 /**
- * Initializes semaphore subsystem. Sets all system semaphores
- * as unreserved (non-existing).
+ * Initializes semaphore subsystem. Puts the static boot semaphores
+ * to the free list and creates the cache for the rest.
  */
 
 void semaphore_init(void)
 {
-    int i;
+    spinlock_reset(&semaphore_free_slock);
+    spinlock_stats_register(&semaphore_free_slock);
+    semaphore_free_list = NULL;
+    semaphore_add_free(semaphore_boot_table, CONFIG_BOOT_SEMAPHORES);
 
-    spinlock_reset(&semaphore_table_slock);
-    for(i = 0; i < CONFIG_MAX_SEMAPHORES; i++)
-        semaphore_table[i].creator = -1;
+    semaphore_cache = kmem_cache_create("semaphore", sizeof(semaphore_t));
 }
 
 /**
- * Creates a semaphore. The actual creation is done by reserving
- * a semaphore from the semaphore table.
+ * Creates a semaphore. The semaphore is taken from the free list, or
+ * from the slab cache if the list is empty.
  *
  * @param value Initial value of the created semaphore
  *
- * @return Pointer to the created semaphore
+ * @return Pointer to the created semaphore, NULL if out of memory
  *
  * @see semaphore_destroy
  */
@@ -82,79 +130,177 @@ void semaphore_init(void)
 semaphore_t *semaphore_create(int value)
 {
     interrupt_status_t intr_status;
-    static int next = 0;
-    int i;
-    int sem_id;
+    semaphore_t *sem;
 
     KERNEL_ASSERT(value >= 0);
 
     intr_status = _interrupt_disable();
-    spinlock_acquire(&semaphore_table_slock);
-
-    /* Find free semaphore from semaphore table */
-    for(i = 0; i < CONFIG_MAX_SEMAPHORES; i++) {
-        sem_id = next;
-        next = (next + 1) % CONFIG_MAX_SEMAPHORES;
-        if (semaphore_table[sem_id].creator == -1) {
-            semaphore_table[sem_id].creator = thread_get_current_thread();
-            break;
-        }
-    }
+    spinlock_acquire(&semaphore_free_slock);
 
-    spinlock_release(&semaphore_table_slock);
+    sem = semaphore_free_list;
+    if (sem != NULL)
+        semaphore_free_list = sem->next_free;
+
+    spinlock_release(&semaphore_free_slock);
     _interrupt_set_state(intr_status);
 
-    if (i == CONFIG_MAX_SEMAPHORES) {
-	/* semaphore table does not have any free semaphores, creation fails */
-        return NULL;
+    if (sem == NULL) {
+        sem = kmem_cache_alloc(semaphore_cache);
+        if (sem == NULL) {
+            /* out of memory, creation fails */
+            return NULL;
+        }
     }
 
-    semaphore_table[sem_id].value = value;
-    spinlock_reset(&semaphore_table[sem_id].slock);
+    sem->creator = thread_get_current_thread();
+    sem->value = value;
+    spinlock_reset(&sem->slock);
+    /* Only the boot semaphores live for the whole run */
+    if (SEMAPHORE_IS_BOOT(sem))
+        spinlock_stats_register(&sem->slock);
+#if CONFIG_LOCK_PROFILE
+    sem->prof = NULL;
+#endif
 
-    return &semaphore_table[sem_id];
+    return sem;
 }
 
 /**
- * Free given semaphore. Semaphore sem is freed for later
- * re-creation by semaphore_create.
+ * Free given semaphore. Semaphore sem is returned to the free list
+ * or to the slab cache for later re-creation by semaphore_create.
  *
  * @param sem Semaphore to free (destroy)
  */
 
 void semaphore_destroy(semaphore_t *sem)
 {
+    interrupt_status_t intr_status;
+
+    KERNEL_ASSERT(sem->creator != -1);
+
+    if (!SEMAPHORE_IS_BOOT(sem)) {
+        sem->creator = -1;
+        kmem_cache_free(semaphore_cache, sem);
+        return;
+    }
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&semaphore_free_slock);
+
     sem->creator = -1;
+    sem->next_free = semaphore_free_list;
+    semaphore_free_list = sem;
+
+    spinlock_release(&semaphore_free_slock);
+    _interrupt_set_state(intr_status);
 }
 
 /**
- * Decreases value of the semaphore sem by one. If semaphore has no free
- * value (its value is 0), this call will block and the call will
- * return only after the semaphores value has been increased by
- * some other thread (semaphore_V).
+ * Gives the semaphore a name under which its contention is profiled
+ * with CONFIG_LOCK_PROFILE. Semaphores with the same name share the
+ * profile. Does nothing if profiling is not enabled.
  *
- * The blocking is implemented by sleeping. This function
- * must not be called by interrupt handlers.
+ * @param sem The semaphore
+ * @param name Name of the semaphore, must stay in memory
+ */
+
+void semaphore_set_name(semaphore_t *sem, const char *name)
+{
+#if CONFIG_LOCK_PROFILE
+    sem->prof = lockprof_register(name);
+#else
+    sem = sem;
+    name = name;
+#endif
+}
+
+/**
+ * Decreases the value of the semaphore by one, sleeping if it was
+ * not positive. If timed is nonzero, sleeps at most msec
+ * milliseconds, after which the semaphore is left as it was.
  *
  * @param sem Semaphore to lower by one.
+ * @param timed Nonzero to limit the wait
+ * @param msec Maximum time to wait in milliseconds
+ *
+ * @return 0 if the semaphore was lowered without waiting, 1 if it was
+ * lowered after waiting, -1 if the wait timed out.
  */
 
-void semaphore_P(semaphore_t *sem)
+static int semaphore_lower(semaphore_t *sem, int timed, uint32_t msec)
 {
     interrupt_status_t intr_status;
+    timeout_t timeout;
+    int timed_out = 0;
 
     intr_status = _interrupt_disable();
     spinlock_acquire(&sem->slock);
 
     sem->value--;
-    if (sem->value < 0) {
-        sleepq_add(sem);
+    if (sem->value >= 0) {
         spinlock_release(&sem->slock);
-        thread_switch();
-    } else {
+        _interrupt_set_state(intr_status);
+        return 0;
+    }
+
+    sleepq_add(sem);
+    if (timed)
+        timeout_sleep_arm(&timeout, sem, msec);
+    spinlock_release(&sem->slock);
+    thread_switch();
+
+    if (timed)
+        timed_out = timeout_sleep_disarm(&timeout);
+    if (timed_out) {
+        /* We are no longer waiting: give back our decrement. A V
+           which came after the timeout found no one to wake and left
+           its increment in the value. */
+        spinlock_acquire(&sem->slock);
+        sem->value++;
         spinlock_release(&sem->slock);
     }
+
     _interrupt_set_state(intr_status);
+    return timed_out ? -1 : 1;
+}
+
+/**
+ * Decreases value of the semaphore sem by one. If semaphore has no free
+ * value (its value is 0), this call will block and the call will
+ * return only after the semaphores value has been increased by
+ * some other thread (semaphore_V).
+ *
+ * The blocking is implemented by sleeping. This function
+ * must not be called by interrupt handlers.
+ *
+ * @param sem Semaphore to lower by one.
+ */
+
+void semaphore_P(semaphore_t *sem)
+{
+    LOCKPROF_ACQUIRE(sem->prof, semaphore_lower(sem, 0, 0) != 0);
+}
+
+/**
+ * Decreases value of the semaphore sem by one like semaphore_P, but
+ * waits at most the given time for the semaphore. If the wait times
+ * out, the semaphore is left as it was.
+ *
+ * This function must not be called by interrupt handlers.
+ *
+ * @param sem Semaphore to lower by one.
+ * @param msec Maximum time to wait in milliseconds
+ *
+ * @return 1 if the semaphore was lowered, 0 if the wait timed out.
+ */
+
+int semaphore_P_timeout(semaphore_t *sem, uint32_t msec)
+{
+    int result;
+
+    LOCKPROF_ACQUIRE(sem->prof,
+                     (result = semaphore_lower(sem, 1, msec)) != 0);
+    return result >= 0;
 }
 
 /**
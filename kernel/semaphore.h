@@ -39,17 +39,26 @@
 
 #include "kernel/spinlock.h"
 #include "kernel/thread.h"
+#include "kernel/lockprof.h"
 
-typedef struct {
+typedef struct semaphore_struct {
     spinlock_t slock;
     int value;
     TID_t creator;
+    /* next semaphore in the free list, used only while unallocated */
+    struct semaphore_struct *next_free;
+#if CONFIG_LOCK_PROFILE
+    /* contention record, NULL if the semaphore is not named */
+    lockprof_t *prof;
+#endif
 } semaphore_t;
 
 void semaphore_init(void);
 semaphore_t *semaphore_create(int value);
 void semaphore_destroy(semaphore_t *sem);
+void semaphore_set_name(semaphore_t *sem, const char *name);
 void semaphore_P(semaphore_t *sem);
+int semaphore_P_timeout(semaphore_t *sem, uint32_t msec);
 void semaphore_V(semaphore_t *sem);
 
 #endif /* BUENOS_KERNEL_SEMAPHORE_H */
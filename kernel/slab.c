@@ -0,0 +1,335 @@
+/*
+ * Slab allocator.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "kernel/slab.h"
+#include "kernel/kmalloc.h"
+#include "kernel/interrupt.h"
+#include "kernel/assert.h"
+#include "vm/pagepool.h"
+#include "lib/libc.h"
+
+/** @name Slab allocator
+ *
+ * The slab allocator keeps caches of equally sized kernel objects
+ * which can be allocated and freed at any time after the page pool
+ * has been initialized, also by interrupt handlers.
+ *
+ * A cache gets its memory from the page pool one page at a time. A
+ * page, called a slab, starts with a header after which it is
+ * divided into objects. Free objects of a slab are chained through
+ * their first word. A slab is on the partial list of its cache while
+ * it has free objects and on the full list otherwise. One fully free
+ * slab is kept in each cache; further ones are returned to the page
+ * pool. Since slabs are page aligned, the slab of an object is found
+ * by rounding its address down to a page.
+ *
+ * In front of the slabs each CPU has a magazine of free objects of
+ * each cache. Allocation takes an object from the magazine of the
+ * calling CPU and freeing puts it there, with interrupts disabled
+ * but without any lock. Only when the magazine runs empty or full
+ * are half of its objects moved from or to the slabs under the cache
+ * spinlock.
+ *
+ * @{
+ */
+
+/* Header at the start of every slab */
+typedef struct kmem_slab_struct {
+    /* cache the slab belongs to */
+    kmem_cache_t *cache;
+    /* links of the partial or full list */
+    struct kmem_slab_struct *next;
+    struct kmem_slab_struct *prev;
+    /* first free object, NULL if none */
+    void *free;
+    /* number of allocated objects, including those in magazines */
+    int inuse;
+} kmem_slab_t;
+
+/* Offset of the first object in a slab */
+#define KMEM_SLAB_HEADER ((sizeof(kmem_slab_t) + 7) & ~7)
+
+/* Number of objects moved between a magazine and the slabs at once */
+#define KMEM_BATCH ((CONFIG_SLAB_MAGAZINE_SIZE + 1) / 2)
+
+/* Returns the slab containing the object */
+#define KMEM_SLAB_OF(object) \
+    ((kmem_slab_t *)((uint32_t)(object) & PAGE_SIZE_MASK))
+
+/**
+ * Initializes a cache in memory provided by the caller.
+ *
+ * @param cache The cache
+ * @param name Name of the cache, must stay in memory
+ * @param size Size of the objects in bytes, at most
+ * KMEM_MAX_OBJECT_SIZE
+ */
+void kmem_cache_init(kmem_cache_t *cache, const char *name, int size)
+{
+    int i;
+
+    KERNEL_ASSERT(size > 0 && size <= KMEM_MAX_OBJECT_SIZE);
+
+    cache->name = name;
+    cache->size = (size + 3) & ~3;
+    cache->per_slab = (PAGE_SIZE - KMEM_SLAB_HEADER) / cache->size;
+
+    spinlock_reset(&cache->slock);
+    spinlock_stats_register(&cache->slock);
+    cache->partial = NULL;
+    cache->full = NULL;
+    cache->empty_slabs = 0;
+
+    for (i = 0; i < CONFIG_MAX_CPUS; i++)
+	cache->magazines[i].count = 0;
+}
+
+/**
+ * Creates a cache. The cache itself is allocated with kmalloc and is
+ * never destroyed.
+ *
+ * @param name Name of the cache, must stay in memory
+ * @param size Size of the objects in bytes, at most
+ * KMEM_MAX_OBJECT_SIZE
+ *
+ * @return The cache, NULL if out of memory
+ */
+kmem_cache_t *kmem_cache_create(const char *name, int size)
+{
+    kmem_cache_t *cache;
+
+    cache = kmalloc(sizeof(kmem_cache_t));
+    if (cache != NULL)
+	kmem_cache_init(cache, name, size);
+
+    return cache;
+}
+
+/* Removes the slab from the list */
+static void kmem_list_remove(kmem_slab_t **list, kmem_slab_t *slab)
+{
+    if (slab->prev != NULL)
+	slab->prev->next = slab->next;
+    else
+	*list = slab->next;
+    if (slab->next != NULL)
+	slab->next->prev = slab->prev;
+}
+
+/* Inserts the slab at the head of the list */
+static void kmem_list_push(kmem_slab_t **list, kmem_slab_t *slab)
+{
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list != NULL)
+	(*list)->prev = slab;
+    *list = slab;
+}
+
+/* Takes a page from the page pool and divides it into free objects.
+   Returns NULL if out of memory. */
+static kmem_slab_t *kmem_slab_create(kmem_cache_t *cache)
+{
+    kmem_slab_t *slab;
+    uint32_t page, object;
+    int i;
+
+    page = pagepool_get_phys_page();
+    if (page == 0)
+	return NULL;
+
+    slab = (kmem_slab_t *)ADDR_PHYS_TO_KERNEL(page);
+    slab->cache = cache;
+    slab->inuse = 0;
+    slab->free = NULL;
+
+    /* chain the objects so that the lowest is taken first */
+    object = (uint32_t)slab + KMEM_SLAB_HEADER 
+	+ (cache->per_slab - 1) * cache->size;
+    for (i = 0; i < cache->per_slab; i++) {
+	*(void **)object = slab->free;
+	slab->free = (void *)object;
+	object -= cache->size;
+    }
+
+    return slab;
+}
+
+/* Moves up to count objects from the slabs to the magazine. Called
+   with interrupts disabled. Returns the number of objects moved. */
+static int kmem_refill(kmem_cache_t *cache, kmem_magazine_t *mag, 
+		       int count)
+{
+    kmem_slab_t *slab, *new_slab;
+    int moved = 0;
+
+    spinlock_acquire(&cache->slock);
+
+    while (moved < count) {
+	slab = cache->partial;
+	if (slab == NULL) {
+	    /* Grow the cache. The page pool is not called with the
+	       cache locked. */
+	    spinlock_release(&cache->slock);
+	    new_slab = kmem_slab_create(cache);
+	    spinlock_acquire(&cache->slock);
+	    if (new_slab == NULL)
+		break;
+	    kmem_list_push(&cache->partial, new_slab);
+	    cache->empty_slabs++;
+	    continue;
+	}
+
+	if (slab->inuse == 0)
+	    cache->empty_slabs--;
+	while (moved < count && slab->free != NULL) {
+	    mag->objects[mag->count++] = slab->free;
+	    slab->free = *(void **)slab->free;
+	    slab->inuse++;
+	    moved++;
+	}
+	if (slab->free == NULL) {
+	    kmem_list_remove(&cache->partial, slab);
+	    kmem_list_push(&cache->full, slab);
+	}
+    }
+
+    spinlock_release(&cache->slock);
+
+    return moved;
+}
+
+/* Returns count objects from the top of the magazine to their slabs.
+   Called with interrupts disabled. */
+static void kmem_flush(kmem_cache_t *cache, kmem_magazine_t *mag, 
+		       int count)
+{
+    kmem_slab_t *slab, *release = NULL;
+    void *object;
+
+    spinlock_acquire(&cache->slock);
+
+    while (count-- > 0) {
+	object = mag->objects[--mag->count];
+	slab = KMEM_SLAB_OF(object);
+
+	if (slab->free == NULL) {
+	    kmem_list_remove(&cache->full, slab);
+	    kmem_list_push(&cache->partial, slab);
+	}
+	*(void **)object = slab->free;
+	slab->free = object;
+	slab->inuse--;
+
+	if (slab->inuse == 0) {
+	    if (cache->empty_slabs > 0) {
+		/* one free slab is enough, release this one */
+		kmem_list_remove(&cache->partial, slab);
+		slab->next = release;
+		release = slab;
+	    } else {
+		cache->empty_slabs++;
+	    }
+	}
+    }
+
+    spinlock_release(&cache->slock);
+
+    while (release != NULL) {
+	slab = release;
+	release = slab->next;
+	pagepool_free_phys_page(ADDR_KERNEL_TO_PHYS((uint32_t)slab));
+    }
+}
+
+/**
+ * Allocates an object from the cache.
+ *
+ * @param cache The cache
+ *
+ * @return The object, NULL if out of memory
+ */
+void *kmem_cache_alloc(kmem_cache_t *cache)
+{
+    interrupt_status_t intr_status;
+    kmem_magazine_t *mag;
+    void *object = NULL;
+
+    intr_status = _interrupt_disable();
+    mag = &cache->magazines[_interrupt_getcpu()];
+
+    if (mag->count > 0 || kmem_refill(cache, mag, KMEM_BATCH) > 0)
+	object = mag->objects[--mag->count];
+
+    _interrupt_set_state(intr_status);
+
+    return object;
+}
+
+/**
+ * Frees an object allocated from the cache.
+ *
+ * @param cache The cache the object was allocated from
+ * @param object The object
+ */
+void kmem_cache_free(kmem_cache_t *cache, void *object)
+{
+    interrupt_status_t intr_status;
+    kmem_magazine_t *mag;
+
+    KERNEL_ASSERT(KMEM_SLAB_OF(object)->cache == cache);
+
+    intr_status = _interrupt_disable();
+    mag = &cache->magazines[_interrupt_getcpu()];
+
+    if (mag->count == CONFIG_SLAB_MAGAZINE_SIZE)
+	kmem_flush(cache, mag, KMEM_BATCH);
+    mag->objects[mag->count++] = object;
+
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Returns the cache an object was allocated from.
+ *
+ * @param object An object allocated with kmem_cache_alloc
+ *
+ * @return The cache of the object
+ */
+kmem_cache_t *kmem_cache_of(void *object)
+{
+    return KMEM_SLAB_OF(object)->cache;
+}
+
+/** @} */
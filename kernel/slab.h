@@ -0,0 +1,83 @@
+/*
+ * Slab allocator.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef BUENOS_KERNEL_SLAB_H
+#define BUENOS_KERNEL_SLAB_H
+
+#include "kernel/config.h"
+#include "kernel/spinlock.h"
+#include "lib/types.h"
+
+/* Largest object size a cache can hold. A slab is one page, which
+   starts with the slab header. */
+#define KMEM_MAX_OBJECT_SIZE 2048
+
+/* Objects cached by one CPU, taken and returned with interrupts
+   disabled on that CPU */
+typedef struct {
+    int count;
+    void *objects[CONFIG_SLAB_MAGAZINE_SIZE];
+} kmem_magazine_t;
+
+struct kmem_slab_struct;
+
+/* A cache of equally sized objects */
+typedef struct {
+    /* name of the cache, for debugging */
+    const char *name;
+    /* size of the objects, rounded up to a word */
+    int size;
+    /* number of objects in one slab */
+    int per_slab;
+
+    /* protects the slab lists and counts below */
+    spinlock_t slock;
+    /* slabs with free objects, fully free ones included */
+    struct kmem_slab_struct *partial;
+    /* slabs with no free objects */
+    struct kmem_slab_struct *full;
+    /* number of fully free slabs in the partial list */
+    int empty_slabs;
+
+    /* per-CPU object caches */
+    kmem_magazine_t magazines[CONFIG_MAX_CPUS];
+} kmem_cache_t;
+
+void kmem_cache_init(kmem_cache_t *cache, const char *name, int size);
+kmem_cache_t *kmem_cache_create(const char *name, int size);
+void *kmem_cache_alloc(kmem_cache_t *cache);
+void kmem_cache_free(kmem_cache_t *cache, void *object);
+kmem_cache_t *kmem_cache_of(void *object);
+
+#endif /* BUENOS_KERNEL_SLAB_H */
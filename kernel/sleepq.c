@@ -40,6 +40,7 @@
 #include "kernel/config.h"
 #include "kernel/interrupt.h"
 #include "kernel/assert.h"
+#include "kernel/trace.h"
 
 /** @name Sleep queue
  *
@@ -53,36 +54,52 @@
  * The resources are referenced by memory address. The address is used
  * only as a key, it is never referenced by the sleep queue mechanism.
  *
+ * Each bucket of the hash table has its own spinlock and a tail
+ * pointer, so sleeping and waking on resources in different buckets
+ * do not contend and threads are appended in constant time. The
+ * threads in a bucket are chained through the next field of the
+ * thread table. The bucket spinlock is acquired before the spinlock
+ * of any thread table entry (see kernel/thread.c). When two bucket
+ * spinlocks are needed, the one with the lower index is acquired
+ * first.
+ *
  * @{
  */
 
 /* Size of the sleep queue hashtable (prime number) */
 #define SLEEPQ_HASHTABLE_SIZE 127
 
-extern thread_table_t thread_table[CONFIG_MAX_THREADS];
-extern spinlock_t thread_table_slock;
+extern thread_table_t *thread_table;
+
+/* One bucket of the sleep queue hashtable */
+typedef struct {
+    /* spinlock for synchronizing access to this bucket */
+    spinlock_t slock;
+    /* first and last thread in the bucket, negative if none */
+    TID_t head;
+    TID_t tail;
+} sleepq_bucket_t;
 
-/* spinlock for synchronizing sleep queue table access */
-static spinlock_t sleepq_slock;
 /* the sleep queue hashtable itself */
-static TID_t sleepq_hashtable[SLEEPQ_HASHTABLE_SIZE];
+static sleepq_bucket_t sleepq_hashtable[SLEEPQ_HASHTABLE_SIZE];
 
 
 /* Hash function used to index the sleep queue table */
 #define SLEEPQ_HASH(res) ((uint32_t)(res) % SLEEPQ_HASHTABLE_SIZE)
 
-/** Initializes the sleep queue system. The hashtable entries are all
- * set to -1 (NULL) and the spinlock is reset (set to 0=free).
+/** Initializes the sleep queue system. The hashtable buckets are all
+ * emptied and their spinlocks reset.
  */
 void sleepq_init(void)
 {
     int i;
 
     for (i=0; i<SLEEPQ_HASHTABLE_SIZE; i++) {
-	sleepq_hashtable[i] = -1;
+	spinlock_reset(&sleepq_hashtable[i].slock);
+	spinlock_stats_register(&sleepq_hashtable[i].slock);
+	sleepq_hashtable[i].head = -1;
+	sleepq_hashtable[i].tail = -1;
     }
-
-    spinlock_reset(&sleepq_slock);
 }
 
 /** Adds the currently running thread into the sleep queue. The thread
@@ -98,7 +115,7 @@ void sleepq_init(void)
  */
 void sleepq_add(void *resource)
 {
-    uint32_t hash;
+    sleepq_bucket_t *bucket;
     TID_t my_tid;
     interrupt_status_t intr_state;
 
@@ -107,7 +124,7 @@ void sleepq_add(void *resource)
     KERNEL_ASSERT((intr_state & INTERRUPT_MASK_ALL) == 0 
 		  || !(intr_state & INTERRUPT_MASK_MASTER));
 
-    hash = SLEEPQ_HASH(resource);
+    bucket = &sleepq_hashtable[SLEEPQ_HASH(resource)];
     my_tid = thread_get_current_thread();
     /* the thread to be added should not have a next entry: */
     thread_table[my_tid].next = -1; 
@@ -116,150 +133,296 @@ void sleepq_add(void *resource)
     /* Idle thread should never do _anything_ (other than its own wait loop) */
     KERNEL_ASSERT(my_tid != IDLE_THREAD_TID);
 
-    spinlock_acquire(&sleepq_slock);
+    spinlock_acquire(&bucket->slock);
 
-    /* Add the current thread to the end of the sleepqueue */
-    if (sleepq_hashtable[hash] <= 0) {
-	/* hashtable entry empty */
-	sleepq_hashtable[hash] = my_tid;
+    /* Add the current thread to the end of the bucket */
+    if (bucket->tail < 0) {
+	bucket->head = my_tid;
     } else {
-	TID_t prev;
-	/* hashtable entry nonempty, chain to end of linked list */
-	prev = sleepq_hashtable[hash];
-	while (thread_table[prev].next > 0) {
-	    prev = thread_table[prev].next;
-	}
-	thread_table[prev].next = my_tid;
+	thread_table[bucket->tail].next = my_tid;
     }
+    bucket->tail = my_tid;
+
+    spinlock_release(&bucket->slock);
 
-    spinlock_release(&sleepq_slock);
+    trace_event(TRACE_SLEEP, my_tid, -1);
 }
 
-/* Import prototype for unsafe function from scheduler.c */
+/* Import prototypes for unsafe functions from scheduler.c */
 void scheduler_add_to_ready_list(TID_t t);
+void scheduler_add_list_to_ready_list(TID_t first);
+
+/* Removes thread t from the given bucket, prev being the thread
+ * before it in the bucket (negative if t is the first). The bucket
+ * spinlock must be held.
+ */
+static void sleepq_unlink(sleepq_bucket_t *bucket, TID_t prev, TID_t t)
+{
+    if (prev < 0) { 
+	/* it was the first entry in the bucket */
+	bucket->head = thread_table[t].next;
+    } else {
+	thread_table[prev].next = thread_table[t].next;
+    }
+    if (bucket->tail == t)
+	bucket->tail = prev;
+
+    thread_table[t].next = -1;
+}
+
+/* Clears the sleeps_on field of a thread removed from the sleep queue.
+ * Returns nonzero if the thread had already gone to sleep and must
+ * be added to the ready to run list by the caller, in which case it
+ * has been marked THREAD_READY.
+ */
+static int sleepq_release(TID_t t)
+{
+    int ready = 0;
+
+    thread_lock(t);
+
+    thread_table[t].sleeps_on = 0;
+    if (thread_table[t].state == THREAD_SLEEPING) {
+	thread_table[t].state = THREAD_READY;
+	ready = 1;
+    }
+
+    thread_unlock(t);
+
+    trace_event(TRACE_WAKE, thread_get_current_thread(), t);
 
+    return ready;
+}
 
 /** Wake the first thread waiting for given resource from the sleep
  * queue. If such a thread exists, it is removed from the sleep queue
  * and placed on the scheduler's ready-to-run list.
  *
  * @param resource Wake the first thread waiting for this resource
+ *
+ * @return The number of threads removed from the sleep queue (0 or 1)
  */
-void sleepq_wake(void *resource)
+int sleepq_wake(void *resource)
 {
-    uint32_t hash;
+    sleepq_bucket_t *bucket;
     interrupt_status_t intr_state;
     TID_t first, prev;
 
-    hash = SLEEPQ_HASH(resource);
+    bucket = &sleepq_hashtable[SLEEPQ_HASH(resource)];
 
     intr_state = _interrupt_disable();
-    spinlock_acquire(&sleepq_slock);
+    spinlock_acquire(&bucket->slock);
 
     /* Find the first entry actually waiting for 'resource', since
      * multiple resources may hash to the same index. 
      */
     prev = -1;
-    first = sleepq_hashtable[hash];
-    while (first > 0 && thread_table[first].sleeps_on != (uint32_t)resource) {
+    first = bucket->head;
+    while (first >= 0 && thread_table[first].sleeps_on != (uint32_t)resource) {
 	prev = first;
 	first = thread_table[first].next;
     }
 
     /* First entry with correct resource found */
-    if (first > 0) {
-	/* remove it from the sleep queue */
-	if (prev <= 0) { 
-	    /* it was the first entry in the table slot */
-	    sleepq_hashtable[hash] = thread_table[first].next;
-	} else {
-	    thread_table[prev].next = thread_table[first].next;
-	}
+    if (first >= 0)
+	sleepq_unlink(bucket, prev, first);
 
-	/* Clear the sleeps_on field and add the thread to the ready
-	 * list (if necessary)
-	 */
-	spinlock_acquire(&thread_table_slock);
-
-	thread_table[first].sleeps_on = 0;
-	thread_table[first].next = -1;
-	
-	if (thread_table[first].state == THREAD_SLEEPING) {
-	    thread_table[first].state = THREAD_READY;
-	    scheduler_add_to_ready_list(first);
-	}
+    spinlock_release(&bucket->slock);
 
-	spinlock_release(&thread_table_slock);
-    }
+    /* Clear the sleeps_on field and add the thread to the ready list
+     * (if necessary). Once removed from the bucket the thread cannot
+     * be found by other wakers, so the bucket need not be locked.
+     */
+    if (first >= 0 && sleepq_release(first))
+	scheduler_add_to_ready_list(first);
 
-    spinlock_release(&sleepq_slock);
     _interrupt_set_state(intr_state);
+
+    return (first >= 0);
 }
 
 
 /** Wake all threads waiting for given resource from the sleep
  * queue. If such threads exists, they are removed from the sleep
- * queue and placed on the scheduler's ready-to-run list.
+ * queue and placed on the scheduler's ready-to-run list. All the
+ * waiters are first collected from the bucket, and those which had
+ * already gone to sleep are then added to the ready-to-run list as
+ * one batch.
  *
  * @param resource Wake threads waiting for this resource
+ *
+ * @return The number of threads removed from the sleep queue
  */
-void sleepq_wake_all(void *resource)
+int sleepq_wake_all(void *resource)
 {
-    uint32_t hash;
+    sleepq_bucket_t *bucket;
     interrupt_status_t intr_state;
-    TID_t first, prev, wake;
+    TID_t t, prev, next;
+    TID_t woken = -1, ready = -1;
+    int count = 0;
 
-    hash = SLEEPQ_HASH(resource);
+    bucket = &sleepq_hashtable[SLEEPQ_HASH(resource)];
 
     intr_state = _interrupt_disable();
-    spinlock_acquire(&sleepq_slock);
+    spinlock_acquire(&bucket->slock);
 
-    /* init linked list traversing variables to the first item */
+    /* Move every entry waiting for 'resource' to the list 'woken'.
+     * Other entries may be waiting for other resources hashing to
+     * the same bucket.
+     */
     prev = -1;
-    first = sleepq_hashtable[hash];
-
-    /* Traverse the whole linked list in order to wake up all threads */
-    while (first > 0) {
-
-	/* Find the next entry actually waiting for 'resource', since
-	 * multiple resources may hash to the same index. 
-	 */
-	while (first > 0 
-	       && thread_table[first].sleeps_on != (uint32_t)resource) {
-	    prev = first;
-	    first = thread_table[first].next;
+    t = bucket->head;
+    while (t >= 0) {
+	next = thread_table[t].next;
+	if (thread_table[t].sleeps_on == (uint32_t)resource) {
+	    sleepq_unlink(bucket, prev, t);
+	    thread_table[t].next = woken;
+	    woken = t;
+	    count++;
+	} else {
+	    prev = t;
 	}
+	t = next;
+    }
+
+    spinlock_release(&bucket->slock);
 
-	/* Next entry w/ resource found */
-	if (first > 0) {
-	    wake = first;
-	    /* remove it from the sleep queue */
-	    if (prev <= 0) { 
-		/* it was the first entry in the table slot */
-		first = sleepq_hashtable[hash] = thread_table[wake].next;
-	    } else {
-		first = thread_table[prev].next = thread_table[wake].next;
-	    }
-
-	    /* Clear the sleeps_on field and add the thread to the ready
-	     * list (if necessary)
-	     */
-	    spinlock_acquire(&thread_table_slock);
-
-	    thread_table[wake].sleeps_on = 0;
-	    thread_table[wake].next      = -1;
-	
-	    if (thread_table[wake].state == THREAD_SLEEPING) {
-		thread_table[wake].state = THREAD_READY;
-		scheduler_add_to_ready_list(wake);
-	    }
-
-	    spinlock_release(&thread_table_slock);
+    /* Release the threads, chaining those which must be made ready.
+     * 'woken' is in reverse order, so prepend to keep the original
+     * order of the sleep queue in 'ready'.
+     */
+    for (t = woken; t >= 0; t = next) {
+	next = thread_table[t].next;
+	thread_table[t].next = -1;
+	if (sleepq_release(t)) {
+	    thread_table[t].next = ready;
+	    ready = t;
 	}
     }
 
-    spinlock_release(&sleepq_slock);
+    if (ready >= 0)
+	scheduler_add_list_to_ready_list(ready);
+
     _interrupt_set_state(intr_state);
+
+    return count;
+}
+
+/** Wake the given thread if it is waiting for the given resource.
+ * The thread is removed from the sleep queue and placed on the
+ * scheduler's ready-to-run list. Used to end timed waits.
+ *
+ * @param resource The resource the thread is waiting for
+ * @param t The thread to wake
+ *
+ * @return 1 if the thread was removed from the sleep queue, 0 if it
+ * was not waiting for the resource
+ */
+int sleepq_wake_thread(void *resource, TID_t t)
+{
+    sleepq_bucket_t *bucket;
+    interrupt_status_t intr_state;
+    TID_t cur, prev;
+
+    bucket = &sleepq_hashtable[SLEEPQ_HASH(resource)];
+
+    intr_state = _interrupt_disable();
+    spinlock_acquire(&bucket->slock);
+
+    prev = -1;
+    cur = bucket->head;
+    while (cur >= 0 && cur != t) {
+	prev = cur;
+	cur = thread_table[cur].next;
+    }
+
+    if (cur >= 0 && thread_table[cur].sleeps_on == (uint32_t)resource)
+	sleepq_unlink(bucket, prev, cur);
+    else
+	cur = -1;
+
+    spinlock_release(&bucket->slock);
+
+    if (cur >= 0 && sleepq_release(cur))
+	scheduler_add_to_ready_list(cur);
+
+    _interrupt_set_state(intr_state);
+
+    return (cur >= 0);
+}
+
+/** Move all threads waiting for one resource to wait for another
+ * resource, without waking them. The moved threads are appended to
+ * the waiters of the new resource in their original order. Used to
+ * requeue the waiters of a condition variable on its lock.
+ *
+ * @param from The resource the threads are waiting for
+ * @param to The resource they will wait for
+ *
+ * @return The number of threads moved
+ */
+int sleepq_requeue(void *from, void *to)
+{
+    sleepq_bucket_t *src, *dst;
+    interrupt_status_t intr_state;
+    TID_t t, prev, next;
+    TID_t head = -1, tail = -1;
+    int count = 0;
+
+    src = &sleepq_hashtable[SLEEPQ_HASH(from)];
+    dst = &sleepq_hashtable[SLEEPQ_HASH(to)];
+
+    intr_state = _interrupt_disable();
+    if (src == dst) {
+	spinlock_acquire(&src->slock);
+    } else if (src < dst) {
+	spinlock_acquire(&src->slock);
+	spinlock_acquire(&dst->slock);
+    } else {
+	spinlock_acquire(&dst->slock);
+	spinlock_acquire(&src->slock);
+    }
+
+    /* Collect the waiters of 'from' in order to the list head..tail */
+    prev = -1;
+    t = src->head;
+    while (t >= 0) {
+	next = thread_table[t].next;
+	if (thread_table[t].sleeps_on == (uint32_t)from) {
+	    sleepq_unlink(src, prev, t);
+	    if (tail < 0)
+		head = t;
+	    else
+		thread_table[tail].next = t;
+	    tail = t;
+	    count++;
+	} else {
+	    prev = t;
+	}
+	t = next;
+    }
+
+    for (t = head; t >= 0; t = thread_table[t].next) {
+	thread_lock(t);
+	thread_table[t].sleeps_on = (uint32_t)to;
+	thread_unlock(t);
+    }
+
+    /* Append the list to the bucket of 'to' */
+    if (head >= 0) {
+	if (dst->tail < 0)
+	    dst->head = head;
+	else
+	    thread_table[dst->tail].next = head;
+	dst->tail = tail;
+    }
+
+    spinlock_release(&src->slock);
+    if (src != dst)
+	spinlock_release(&dst->slock);
+    _interrupt_set_state(intr_state);
+
+    return count;
 }
 
 /** @} */
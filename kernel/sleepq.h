@@ -37,10 +37,14 @@
 #ifndef BUENOS_KERNEL_SLEEPQ_H
 #define BUENOS_KERNEL_SLEEPQ_H
 
+#include "kernel/thread.h"
+
 /* Prototypes for sleep queue functions */
 void sleepq_init(void);
 void sleepq_add(void *resource);
-void sleepq_wake(void *resource);
-void sleepq_wake_all(void *resource);
+int sleepq_wake(void *resource);
+int sleepq_wake_all(void *resource);
+int sleepq_wake_thread(void *resource, TID_t t);
+int sleepq_requeue(void *from, void *to);
 
 #endif /* BUENOS_KERNEL_SLEEPQ_H */
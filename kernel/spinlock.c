@@ -0,0 +1,154 @@
+/*
+ * Spinlock statistics.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "kernel/spinlock.h"
+#include "kernel/config.h"
+
+#if CONFIG_SPINLOCK_STATS
+
+#include "drivers/timer.h"
+#include "lib/libc.h"
+
+/** @name Spinlock statistics
+ *
+ * With CONFIG_SPINLOCK_STATS each spinlock counts how many times it
+ * has been acquired, how many iterations CPUs have spun waiting for
+ * it and the longest time it has been held. Spinlocks registered with
+ * spinlock_stats_register are remembered (up to
+ * CONFIG_SPINLOCK_STATS_LOCKS locks), and spinlock_stats_print lists
+ * the statistics of those which have been acquired. Only locks which
+ * exist for the whole run may be registered, since a registered lock
+ * is never forgotten; locks on the stack or in freeable memory are
+ * not listed. The locks are identified by address, which can be
+ * looked up in the kernel symbol map.
+ *
+ * @{
+ */
+
+/* Registered locks, protected by spinlock_stats_lock */
+static spinlock_t *spinlock_stats_locks[CONFIG_SPINLOCK_STATS_LOCKS];
+static int spinlock_stats_count;
+
+/* A bare ticket lock, since the registry cannot use spinlock_t */
+static int spinlock_stats_lock;
+
+/**
+ * Resets the spinlock to the free state and clears its statistics.
+ *
+ * @param slock The spinlock
+ */
+void spinlock_reset(spinlock_t *slock)
+{
+    _spinlock_reset(&slock->lock);
+    slock->acquisitions = 0;
+    slock->spins        = 0;
+    slock->max_hold     = 0;
+    slock->acquired_at  = 0;
+}
+
+/**
+ * Registers the spinlock for spinlock_stats_print if not already
+ * registered. The spinlock must never be freed.
+ *
+ * @param slock The spinlock
+ */
+void spinlock_stats_register(spinlock_t *slock)
+{
+    int i;
+
+    _spinlock_acquire(&spinlock_stats_lock);
+    for (i=0; i<spinlock_stats_count; i++) {
+	if (spinlock_stats_locks[i] == slock)
+	    break;
+    }
+    if (i == spinlock_stats_count 
+	&& spinlock_stats_count < CONFIG_SPINLOCK_STATS_LOCKS) {
+	spinlock_stats_locks[spinlock_stats_count++] = slock;
+    }
+    _spinlock_release(&spinlock_stats_lock);
+}
+
+/**
+ * Acquires the spinlock and accounts the acquisition.
+ *
+ * @param slock The spinlock
+ */
+void spinlock_acquire(spinlock_t *slock)
+{
+    uint32_t spins;
+
+    spins = _spinlock_acquire(&slock->lock);
+    slock->acquired_at = timer_get_ticks();
+    slock->acquisitions++;
+    slock->spins += spins;
+}
+
+/**
+ * Releases the spinlock and updates its maximum hold time.
+ *
+ * @param slock The spinlock
+ */
+void spinlock_release(spinlock_t *slock)
+{
+    uint32_t held;
+
+    held = timer_get_ticks() - slock->acquired_at;
+    if (held > slock->max_hold)
+	slock->max_hold = held;
+    _spinlock_release(&slock->lock);
+}
+
+/**
+ * Prints the statistics of every registered spinlock which has been
+ * acquired at least once. The statistics are read without locking.
+ */
+void spinlock_stats_print(void)
+{
+    spinlock_t *slock;
+    int i;
+
+    kprintf("Spinlock statistics:\n");
+    kprintf("    address acquisitions      spins   max hold\n");
+    for (i=0; i<spinlock_stats_count; i++) {
+	slock = spinlock_stats_locks[i];
+	if (slock->acquisitions == 0)
+	    continue;
+	kprintf(" 0x%.8x %12u %10u %10u\n", (uint32_t)slock,
+		slock->acquisitions, slock->spins, slock->max_hold);
+    }
+}
+
+/** @} */
+
+#endif /* CONFIG_SPINLOCK_STATS */
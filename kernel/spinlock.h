@@ -37,10 +37,44 @@
 #ifndef BUENOS_KERNEL_SPINLOCK_H
 #define BUENOS_KERNEL_SPINLOCK_H
 
+#include "kernel/config.h"
+#include "lib/types.h"
+
+#if CONFIG_SPINLOCK_STATS
+
+/* Spinlock with contention statistics. The statistics are updated
+   while the lock is held. */
+typedef struct {
+    /* the ticket lock itself, must be the first field */
+    int lock;
+    /* number of times the lock has been acquired */
+    uint32_t acquisitions;
+    /* total number of spin iterations waiting for the lock */
+    uint32_t spins;
+    /* longest time the lock has been held, in CPU cycles */
+    uint32_t max_hold;
+    /* CP0 count when the lock was acquired */
+    uint32_t acquired_at;
+} spinlock_t;
+
+void spinlock_stats_register(spinlock_t *slock);
+void spinlock_stats_print(void);
+
+#else
+
 typedef int spinlock_t;
 
+#define spinlock_stats_register(slock) ((void)(slock))
+
+#endif /* CONFIG_SPINLOCK_STATS */
+
 void spinlock_reset(spinlock_t *slock);
 void spinlock_acquire(spinlock_t *slock);
 void spinlock_release(spinlock_t *slock);
 
+/* The ticket lock primitives, see kernel/_spinlock.S */
+void _spinlock_reset(int *slock);
+uint32_t _spinlock_acquire(int *slock);
+void _spinlock_release(int *slock);
+
 #endif /* BUENOS_KERNEL_SPINLOCK_H */
@@ -41,5 +41,7 @@
 #include "kernel/spinlock.h"
 #include "kernel/sleepq.h"
 #include "kernel/semaphore.h"
+#include "kernel/lock_cond.h"
+#include "kernel/rwlock.h"
 
 #endif /* BUENOS_KERNEL_SYNCH_H */
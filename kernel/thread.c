@@ -43,33 +43,67 @@
 #include "kernel/config.h"
 #include "kernel/interrupt.h"
 #include "kernel/idle.h"
+#include "kernel/kmalloc.h"
+#include "kernel/trace.h"
+#include "kernel/timeout.h"
+#include "kernel/sleepq.h"
+#include "vm/pagepool.h"
 
 /** @name Thread library
  *
  * Library containing thread creation, control and destruction functions.
  *
+ * Locking: there is no lock for the whole thread table. The state
+ * and sleeps_on fields of a thread table entry are protected by the
+ * spinlock of that entry (see thread_lock). The next field belongs
+ * to the list the thread is on and is protected by the lock of that
+ * list: a ready to run queue in the scheduler, a sleep queue bucket
+ * or the list of free entries, which is protected by
+ * thread_free_slock. Interrupts must be disabled
+ * while any of these is held. When several locks are needed, they
+ * are taken in this order:
+ *
+ *   sleep queue bucket -> thread entry -> ready to run queue
+ *
+ * thread_free_slock is never held together with any other lock. At
+ * most one thread entry lock and one ready to run queue lock may be
+ * held at a time.
+ *
  * @{
  */
 
-/** Spinlock which must be held when manipulating the thread table */
-spinlock_t thread_table_slock;
+/** Spinlocks of the thread table entries, see thread_lock */
+static spinlock_t *thread_slocks;
+
+/** Spinlock protecting the free list of thread table entries */
+static spinlock_t thread_free_slock;
 
-/** The table containing all threads in the system, whether active or not. */
-thread_table_t thread_table[CONFIG_MAX_THREADS];
+/** The table containing all threads in the system, whether active or
+ *  not. Allocated at boot time. */
+thread_table_t *thread_table;
 
-/* Thread stack areas for kernel threads */
-char thread_stack_areas[CONFIG_THREAD_STACKSIZE * CONFIG_MAX_THREADS];
+/** Number of entries in the thread table */
+int thread_table_size;
+
+/** Queue of free thread table entries, linked through the next
+ *  field. Protected by thread_free_slock. Entries are reused in the
+ *  order they were freed. */
+static TID_t thread_free_head;
+static TID_t thread_free_tail;
 
 /* Import running thread id table from scheduler */
 extern TID_t scheduler_current_thread[CONFIG_MAX_CPUS];
 
-/** Initializes the threading system. Does this by setting all thread
- *  table entry states to THREAD_FREE. Called only once before any
- *  threads are created.
+/** Initializes the threading system. Decides the size of the thread
+ *  table from the amount of physical memory, allocates the table,
+ *  sets all entries to THREAD_FREE and places them on the free
+ *  list. Called only once before any threads are created and before
+ *  the virtual memory system is initialized (uses kmalloc).
  */
 void thread_table_init(void)
 {
     int i;
+    uint32_t idle_stack;
 
     /* Thread table entry _must_ be 64 bytes long, because the
        context switching code in kernel/cswitch.S expects that. Let's
@@ -78,25 +112,52 @@ void thread_table_init(void)
        the end of thread_table_t definition in kernel/thread.h */
     KERNEL_ASSERT(sizeof(thread_table_t) == 64);
 
-    spinlock_reset(&thread_table_slock);
+    /* Stacks are single pages from the page pool */
+    KERNEL_ASSERT(CONFIG_THREAD_STACKSIZE == PAGE_SIZE);
+
+    thread_table_size = kmalloc_get_numpages() / CONFIG_THREAD_PAGES;
+    thread_table_size = MAX(thread_table_size, 2);
+    thread_table_size = MIN(thread_table_size, CONFIG_MAX_THREADS);
+
+    thread_table = kmalloc(thread_table_size * sizeof(thread_table_t));
+    thread_slocks = kmalloc(thread_table_size * sizeof(spinlock_t));
 
-    /* Init all entries to 'NULL' */
-    for (i=0; i<CONFIG_MAX_THREADS; i++) {
-	/* Set context pointers to the top of the stack*/
-	thread_table[i].context      = (context_t *) (thread_stack_areas
-	    +CONFIG_THREAD_STACKSIZE*i + CONFIG_THREAD_STACKSIZE - 
-						      sizeof(context_t));
+    kprintf("Thread table: %d entries\n", thread_table_size);
+
+    spinlock_reset(&thread_free_slock);
+    spinlock_stats_register(&thread_free_slock);
+
+    /* Init all entries to 'NULL' and chain them to the free list */
+    for (i=0; i<thread_table_size; i++) {
+	spinlock_reset(&thread_slocks[i]);
+	spinlock_stats_register(&thread_slocks[i]);
+	thread_table[i].context      = NULL;
 	thread_table[i].user_context = NULL;
 	thread_table[i].state        = THREAD_FREE;
 	thread_table[i].sleeps_on    = 0;
 	thread_table[i].pagetable    = NULL;
 	thread_table[i].process_id   = -1;	
-	thread_table[i].next         = -1;	
+	thread_table[i].next         = i+1;	
+	thread_table[i].priority     = 0;
+	thread_table[i].runtime      = 0;
+	thread_table[i].stack        = 0;
     }
+    thread_table[thread_table_size-1].next = -1;
+
+    /* The idle thread is never on the free list */
+    thread_free_head = IDLE_THREAD_TID + 1;
+    thread_free_tail = thread_table_size - 1;
+    thread_table[IDLE_THREAD_TID].next = -1;
+
+    /* The page pool is not yet available, so the idle thread stack
+       is allocated from permanent kernel memory. */
+    idle_stack = (uint32_t) kmalloc(CONFIG_THREAD_STACKSIZE);
+    thread_table[IDLE_THREAD_TID].stack = idle_stack;
 
+    thread_table[IDLE_THREAD_TID].context = (context_t *) 
+	(idle_stack + CONFIG_THREAD_STACKSIZE - sizeof(context_t));
     thread_table[IDLE_THREAD_TID].context->cpu_regs[MIPS_REGISTER_SP] =
-	(uint32_t) thread_stack_areas + CONFIG_THREAD_STACKSIZE -4 -
-	sizeof(context_t);
+	idle_stack + CONFIG_THREAD_STACKSIZE -4 - sizeof(context_t);
     thread_table[IDLE_THREAD_TID].context->pc = 
         (uint32_t) _idle_thread_wait_loop;
     thread_table[IDLE_THREAD_TID].context->status = 
@@ -106,61 +167,104 @@ void thread_table_init(void)
 	thread_table[IDLE_THREAD_TID].context;
 }
 
+/** Acquires the spinlock of the given thread table entry. The lock
+ * must be held when changing the state or sleeps_on fields of an
+ * entry which may be in use by other CPUs. Interrupts must be
+ * disabled. See the lock ordering above.
+ *
+ * @param t The thread whose entry is locked
+ */
+void thread_lock(TID_t t)
+{
+    spinlock_acquire(&thread_slocks[t]);
+}
+
+/** Releases the spinlock of the given thread table entry.
+ *
+ * @param t The thread whose entry is unlocked
+ */
+void thread_unlock(TID_t t)
+{
+    spinlock_release(&thread_slocks[t]);
+}
+
+/** Returns the given thread table entry to the free list. The free
+ *  list spinlock must be held and interrupts disabled.
+ *
+ * @param t The thread table entry to release.
+ */
+static void thread_free_slot(TID_t t)
+{
+    thread_table[t].state = THREAD_FREE;
+    thread_table[t].next  = -1;
+
+    if (thread_free_tail < 0) {
+	thread_free_head = t;
+    } else {
+	thread_table[thread_free_tail].next = t;
+    }
+    thread_free_tail = t;
+}
+
 
-/** Creates a new thread. A free slot is allocated from the thread
- * table for the new thread and its content is initialized to 'nil'
- * values. The new thread will call function 'func' with the argument
- * 'arg' when the thread is run by thread_run().
+/** Creates a new thread. A free slot is taken from the head of the
+ * free list of the thread table and a kernel stack page is allocated
+ * from the page pool for the new thread. The entry is initialized to
+ * 'nil' values. The new thread will call function 'func' with the
+ * argument 'arg' when the thread is run by thread_run().
  *
  * @param func Function pointer to the threads 'main' function.
  * @param arg Argument to pass to 'func' (meaning defined by 'func').
  *
  * @return The thread ID of the created thread, or negative if
- * creation failed (thread table is full).
+ * creation failed (thread table is full or no memory for the stack).
  */
 TID_t thread_create(void (*func)(uint32_t), uint32_t arg)
 {
-    static TID_t next_tid = 0;
-    TID_t i, tid = -1;
-
+    TID_t i, tid;
+    uint32_t stack;
 
     interrupt_status_t intr_status;
       
     intr_status = _interrupt_disable();
 
-    spinlock_acquire(&thread_table_slock);
+    spinlock_acquire(&thread_free_slock);
     
-    /* Find the first free thread table entry starting from 'next_tid' */
-    for (i=0; i<CONFIG_MAX_THREADS; i++) {
-	TID_t t = (i + next_tid) % CONFIG_MAX_THREADS;
-
-	if(t == IDLE_THREAD_TID)
-	    continue;
-	
-	if (thread_table[t].state
-	    == THREAD_FREE) {
-	    tid = t;
-	    break;
-	}
-    }
+    tid = thread_free_head;
 
     /* Is the thread table full? */
     if (tid < 0) { 
-	spinlock_release(&thread_table_slock);
+	spinlock_release(&thread_free_slock);
 	_interrupt_set_state(intr_status);
 	return tid;
     }
 
-    next_tid = (tid+1) % CONFIG_MAX_THREADS;
+    KERNEL_ASSERT(thread_table[tid].state == THREAD_FREE);
+
+    thread_free_head = thread_table[tid].next;
+    if (thread_free_head < 0)
+	thread_free_tail = -1;
 
     thread_table[tid].state = THREAD_NONREADY;
 
-    spinlock_release(&thread_table_slock);
+    spinlock_release(&thread_free_slock);
     _interrupt_set_state(intr_status);
 
-    thread_table[tid].context      = (context_t *) (thread_stack_areas
-	+CONFIG_THREAD_STACKSIZE*tid + CONFIG_THREAD_STACKSIZE - 
-	 sizeof(context_t));
+    stack = pagepool_get_phys_page();
+    if (stack == 0) {
+	/* Out of memory, give the entry back */
+	intr_status = _interrupt_disable();
+	spinlock_acquire(&thread_free_slock);
+	thread_free_slot(tid);
+	spinlock_release(&thread_free_slock);
+	_interrupt_set_state(intr_status);
+	return -1;
+    }
+    stack = ADDR_PHYS_TO_KERNEL(stack);
+
+    thread_table[tid].stack        = stack;
+    thread_table[tid].context      = (context_t *) 
+	(stack + CONFIG_THREAD_STACKSIZE - sizeof(context_t));
 
     for (i=0; i< (int) sizeof(context_t)/4; i++) {
 	*(((uint32_t *) thread_table[tid].context) + i) = 0;
@@ -171,15 +275,15 @@ TID_t thread_create(void (*func)(uint32_t), uint32_t arg)
     thread_table[tid].sleeps_on    = 0;
     thread_table[tid].process_id   = -1;
     thread_table[tid].next         = -1;
+    thread_table[tid].priority     = 0;
+    thread_table[tid].runtime      = 0;
 
     /* Make sure that we always have a valid back reference on context chain */
     thread_table[tid].context->prev_context = thread_table[tid].context;
 
     /* set stack pointer to the end of stack */
     thread_table[tid].context->cpu_regs[MIPS_REGISTER_SP] = 
-	(uint32_t)thread_stack_areas
-	+ (CONFIG_THREAD_STACKSIZE * tid) 
-	+ CONFIG_THREAD_STACKSIZE-4-
+	stack + CONFIG_THREAD_STACKSIZE-4-
 	sizeof(context_t); /* to the end of stack */
 
     /* set program counter to the specified function */
@@ -200,6 +304,8 @@ TID_t thread_create(void (*func)(uint32_t), uint32_t arg)
     thread_table[tid].context->status = 
         INTERRUPT_MASK_ALL | INTERRUPT_MASK_MASTER;
 
+    trace_thread_create(tid);
+
     return tid;
 }
 
@@ -233,6 +339,28 @@ void thread_switch(void)
       _interrupt_set_state(intr_status);
 }
 
+/**
+ * Puts the calling thread to sleep for at least the given time.
+ * Must not be called by interrupt handlers.
+ *
+ * @param msec Time to sleep in milliseconds
+ */
+void thread_sleep(uint32_t msec)
+{
+    interrupt_status_t intr_status;
+    timeout_t timeout;
+
+    intr_status = _interrupt_disable();
+
+    /* Nobody else wakes the timeout, so it is a private resource */
+    sleepq_add(&timeout);
+    timeout_sleep_arm(&timeout, &timeout, msec);
+    thread_switch();
+    timeout_sleep_disarm(&timeout);
+
+    _interrupt_set_state(intr_status);
+}
+
 /**
  * Return the TID of the calling thread. 
  * Finds out what is the TID of the thread calling this function.
@@ -312,9 +440,11 @@ void thread_finish(void)
     /* Check that the page mappings have been cleared. */
     KERNEL_ASSERT(thread_table[my_tid].pagetable == NULL);
 
-    spinlock_acquire(&thread_table_slock);
+    trace_event(TRACE_FINISH, my_tid, -1);
+
+    thread_lock(my_tid);
     thread_table[my_tid].state = THREAD_DYING;
-    spinlock_release(&thread_table_slock);
+    thread_unlock(my_tid);
 
     _interrupt_enable();
     _interrupt_generate_sw0();
@@ -323,4 +453,27 @@ void thread_finish(void)
     KERNEL_PANIC("thread_finish(): thread was not destroyed");
 }
 
+/** Destroys a dead thread. The kernel stack page of the thread is
+ * returned to the page pool and the thread table entry to the free
+ * list. Called by the scheduler after the DYING thread has been
+ * switched out for the last time, so nothing runs on the stack
+ * anymore. Interrupts must be disabled and no thread table entry
+ * spinlock may be held.
+ *
+ * @param t The thread to destroy, must be in state THREAD_DYING.
+ */
+void thread_free_entry(TID_t t)
+{
+    KERNEL_ASSERT(t != IDLE_THREAD_TID);
+    KERNEL_ASSERT(thread_table[t].state == THREAD_DYING);
+
+    pagepool_free_phys_page(ADDR_KERNEL_TO_PHYS(thread_table[t].stack));
+    thread_table[t].stack   = 0;
+    thread_table[t].context = NULL;
+
+    spinlock_acquire(&thread_free_slock);
+    thread_free_slot(t);
+    spinlock_release(&thread_free_slock);
+}
+
 /** @} */
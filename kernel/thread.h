@@ -76,8 +76,15 @@ typedef struct {
     /* pointer to the next thread in list (<0 = end of list) */
     TID_t next; 
 
+    /* scheduling priority level, 0 is the highest */
+    uint32_t priority;
+    /* cycles run on the current priority level */
+    uint32_t runtime;
+    /* bottom of the kernel stack of this thread */
+    uint32_t stack;
+
     /* pad to 64 bytes */
-    uint32_t dummy_alignment_fill[9]; 
+    uint32_t dummy_alignment_fill[6]; 
 } thread_table_t;
 
 /* function prototypes */
@@ -90,10 +97,15 @@ thread_table_t *thread_get_current_thread_entry(void);
 
 void thread_switch(void);
 #define thread_yield thread_switch
+void thread_sleep(uint32_t msec);
 
 void thread_goto_userland(context_t *usercontext);
 
 void thread_finish(void);
+void thread_free_entry(TID_t t);
+
+void thread_lock(TID_t t);
+void thread_unlock(TID_t t);
 
 
 #define USERLAND_ENABLE_BIT 0x00000010
@@ -0,0 +1,388 @@
+/*
+ * Timeouts.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "kernel/timeout.h"
+#include "kernel/sleepq.h"
+#include "kernel/spinlock.h"
+#include "kernel/interrupt.h"
+#include "drivers/timer.h"
+#include "drivers/metadev.h"
+
+/** @name Timeouts
+ *
+ * This module implements timeouts with a hierarchical timing wheel
+ * driven by the CP0 timer interrupt. Time is counted in ticks of one
+ * millisecond, derived from the CP0 cycle counter and the clock speed
+ * reported by the RTC.
+ *
+ * The wheel has TIMEOUT_LEVELS levels of TIMEOUT_SLOTS slots. Level
+ * 0 has one slot per tick, and each slot of level n covers a whole
+ * revolution of level n-1. A timeout is put in the lowest level
+ * whose span covers its expiry time, so adding and cancelling are
+ * O(1). Whenever level n-1 completes a revolution, the next slot of
+ * level n is cascaded, that is its timeouts are redistributed to the
+ * lower levels. Each timeout is cascaded at most TIMEOUT_LEVELS-1
+ * times, so expiry is O(1) amortized and nothing scans all timeouts
+ * or all threads on a tick.
+ *
+ * The wheel is advanced from the timer interrupt of any CPU. While
+ * timeouts are pending the scheduler keeps the timer interrupt of
+ * every CPU at most one tick apart, also on idle CPUs in tickless
+ * mode. When no timeouts are pending the clock is not advanced at
+ * all; it is brought up to date when a timeout is added. The CP0
+ * counters of the CPUs are assumed to run in lockstep.
+ *
+ * Expiry functions are called with the wheel spinlock held, so
+ * timeout_cancel returns only after a running expiry function has
+ * finished. The wheel spinlock is taken before the sleep queue
+ * spinlocks.
+ *
+ * @{
+ */
+
+/* Number of levels in the timing wheel */
+#define TIMEOUT_LEVELS 4
+
+/* log2 of the number of slots on one level */
+#define TIMEOUT_SLOT_BITS 6
+
+/* Number of slots on one level */
+#define TIMEOUT_SLOTS (1 << TIMEOUT_SLOT_BITS)
+
+/* Mask for the slot index */
+#define TIMEOUT_SLOT_MASK (TIMEOUT_SLOTS - 1)
+
+/* Longest timeout in ticks the wheel can hold */
+#define TIMEOUT_MAX_TICKS ((1 << (TIMEOUT_LEVELS * TIMEOUT_SLOT_BITS)) - 1)
+
+/* The timing wheel. Each slot is a circular list with a dummy head. */
+static timeout_link_t timeout_wheel[TIMEOUT_LEVELS][TIMEOUT_SLOTS];
+
+/* The next tick to be processed */
+static uint32_t timeout_ticks;
+
+/* CP0 cycle count at which the tick timeout_ticks begins */
+static uint32_t timeout_tick_start;
+
+/* Length of one tick in CP0 cycles */
+static uint32_t timeout_tick_cycles;
+
+/* Number of pending timeouts */
+static volatile int timeout_count;
+
+/* Spinlock protecting the timing wheel and the clock */
+static spinlock_t timeout_slock;
+
+/**
+ * Initializes the timing wheel. Must be called after the RTC has
+ * been initialized.
+ */
+void timeout_init(void)
+{
+    int i, j;
+
+    spinlock_reset(&timeout_slock);
+    spinlock_stats_register(&timeout_slock);
+
+    for (i = 0; i < TIMEOUT_LEVELS; i++) {
+	for (j = 0; j < TIMEOUT_SLOTS; j++) {
+	    timeout_wheel[i][j].next = &timeout_wheel[i][j];
+	    timeout_wheel[i][j].prev = &timeout_wheel[i][j];
+	}
+    }
+
+    timeout_tick_cycles = rtc_get_clockspeed() / 1000;
+    if (timeout_tick_cycles == 0)
+	timeout_tick_cycles = 1;
+
+    timeout_ticks = 0;
+    timeout_tick_start = timer_get_ticks();
+    timeout_count = 0;
+}
+
+/* Puts the timeout to the slot matching its expiry time. The wheel
+   spinlock must be held. */
+static void timeout_insert(timeout_t *timeout)
+{
+    uint32_t expires = timeout->expires;
+    uint32_t delta = expires - timeout_ticks;
+    timeout_link_t *head;
+    int level;
+
+    if ((int32_t)delta < 0) {
+	/* Already due: run on the next tick processed */
+	expires = timeout_ticks;
+	delta = 0;
+    }
+
+    for (level = 0; level < TIMEOUT_LEVELS - 1; level++) {
+	if (delta < (1U << ((level + 1) * TIMEOUT_SLOT_BITS)))
+	    break;
+    }
+
+    head = &timeout_wheel[level]
+	[(expires >> (level * TIMEOUT_SLOT_BITS)) & TIMEOUT_SLOT_MASK];
+
+    timeout->link.next = head;
+    timeout->link.prev = head->prev;
+    head->prev->next = &timeout->link;
+    head->prev = &timeout->link;
+}
+
+/* Removes the timeout from its slot. The wheel spinlock must be held. */
+static void timeout_unlink(timeout_t *timeout)
+{
+    timeout->link.prev->next = timeout->link.next;
+    timeout->link.next->prev = timeout->link.prev;
+    timeout->link.next = NULL;
+    timeout->link.prev = NULL;
+}
+
+/* Redistributes the timeouts in the current slot of the given level
+   to the lower levels. Returns the index of the slot. The wheel
+   spinlock must be held. */
+static int timeout_cascade(int level)
+{
+    timeout_link_t *head, *link;
+    int index;
+
+    index = (timeout_ticks >> (level * TIMEOUT_SLOT_BITS)) & TIMEOUT_SLOT_MASK;
+    head = &timeout_wheel[level][index];
+
+    while ((link = head->next) != head) {
+	timeout_unlink((timeout_t *)link);
+	timeout_insert((timeout_t *)link);
+    }
+
+    return index;
+}
+
+/* Processes the tick timeout_ticks: cascades the higher levels if
+   level 0 starts a new revolution and runs the timeouts expiring on
+   this tick. The wheel spinlock must be held. */
+static void timeout_run_tick(void)
+{
+    timeout_link_t *head, *link;
+    timeout_t *timeout;
+    int level;
+
+    for (level = 1; level < TIMEOUT_LEVELS; level++) {
+	if (((timeout_ticks >> ((level - 1) * TIMEOUT_SLOT_BITS))
+	     & TIMEOUT_SLOT_MASK) != 0)
+	    break;
+	timeout_cascade(level);
+    }
+
+    head = &timeout_wheel[0][timeout_ticks & TIMEOUT_SLOT_MASK];
+    while ((link = head->next) != head) {
+	timeout = (timeout_t *)link;
+	timeout_unlink(timeout);
+	timeout->pending = 0;
+	timeout_count--;
+	timeout->func(timeout);
+    }
+
+    timeout_ticks++;
+}
+
+/* Processes the ticks which have begun since the last call. If no
+   timeouts are pending the clock is only moved forward. The wheel
+   spinlock must be held. */
+static void timeout_advance(void)
+{
+    uint32_t cycles, elapsed;
+
+    cycles = timer_get_ticks() - timeout_tick_start;
+
+    /* The counter of this CPU may be slightly behind the one which
+       advanced the wheel last. With nothing pending the wheel may
+       also have been left alone for so long that the difference looks
+       negative, but then it does not matter. */
+    if ((int32_t)cycles < 0 && timeout_count > 0)
+	return;
+
+    elapsed = cycles / timeout_tick_cycles;
+    timeout_tick_start += elapsed * timeout_tick_cycles;
+
+    if (timeout_count == 0) {
+	timeout_ticks += elapsed;
+	return;
+    }
+
+    while (elapsed-- > 0)
+	timeout_run_tick();
+}
+
+/**
+ * Sets a timeout which calls func after at least msec milliseconds.
+ * The function is called with interrupts disabled, in interrupt
+ * context, and must not block. The timeout must not be pending.
+ *
+ * @param timeout The timeout to set
+ * @param msec Milliseconds until the timeout expires
+ * @param func Function called when the timeout expires
+ */
+void timeout_add(timeout_t *timeout, uint32_t msec,
+                 void (*func)(timeout_t *timeout))
+{
+    interrupt_status_t intr_status;
+
+    if (msec > TIMEOUT_MAX_TICKS - 1)
+	msec = TIMEOUT_MAX_TICKS - 1;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&timeout_slock);
+
+    timeout_advance();
+
+    /* The current tick has partly passed already */
+    timeout->expires = timeout_ticks + msec + 1;
+    timeout->func = func;
+    timeout->pending = 1;
+    timeout_insert(timeout);
+    timeout_count++;
+
+    spinlock_release(&timeout_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Cancels a timeout. If the expiry function is running on another
+ * CPU, waits until it has returned.
+ *
+ * @param timeout The timeout to cancel
+ *
+ * @return 1 if the timeout was pending, 0 if it had already expired
+ * or was never set.
+ */
+int timeout_cancel(timeout_t *timeout)
+{
+    interrupt_status_t intr_status;
+    int pending;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&timeout_slock);
+
+    pending = timeout->pending;
+    if (pending) {
+	timeout_unlink(timeout);
+	timeout->pending = 0;
+	timeout_count--;
+    }
+
+    spinlock_release(&timeout_slock);
+    _interrupt_set_state(intr_status);
+
+    return pending;
+}
+
+/**
+ * Advances the timing wheel, running the expired timeouts. Called
+ * from the timer interrupt with interrupts disabled.
+ */
+void timeout_tick(void)
+{
+    if (timeout_count == 0)
+	return;
+
+    spinlock_acquire(&timeout_slock);
+    timeout_advance();
+    spinlock_release(&timeout_slock);
+}
+
+/**
+ * Returns the number of CP0 cycles until the next tick begins, or 0
+ * if no timeouts are pending and the wheel need not be advanced.
+ * Used by the scheduler when it sets the timer interrupt.
+ *
+ * @return Cycles until the next tick, or 0
+ */
+uint32_t timeout_next_tick(void)
+{
+    uint32_t elapsed;
+
+    if (timeout_count == 0)
+	return 0;
+
+    elapsed = timer_get_ticks() - timeout_tick_start;
+    if (elapsed >= timeout_tick_cycles)
+	return 1;
+
+    return timeout_tick_cycles - elapsed;
+}
+
+/* Expiry function of timed sleeps: removes the thread from the sleep
+   queue unless it has already been woken up. */
+static void timeout_sleep_expire(timeout_t *timeout)
+{
+    timeout->expired = sleepq_wake_thread(timeout->resource,
+					  timeout->thread);
+}
+
+/**
+ * Limits the time the current thread sleeps on a resource. Called
+ * after sleepq_add and before thread_switch, with interrupts
+ * disabled. If the thread is still in the sleep queue after msec
+ * milliseconds, it is woken up. After waking up the thread must
+ * call timeout_sleep_disarm.
+ *
+ * @param timeout Timeout to use, normally on the caller's stack
+ * @param resource The resource the thread sleeps on
+ * @param msec Maximum time to sleep in milliseconds
+ */
+void timeout_sleep_arm(timeout_t *timeout, void *resource, uint32_t msec)
+{
+    timeout->resource = resource;
+    timeout->thread = thread_get_current_thread();
+    timeout->expired = 0;
+    timeout->pending = 0;
+    timeout_add(timeout, msec, &timeout_sleep_expire);
+}
+
+/**
+ * Cancels the timeout of a timed sleep after the thread has woken
+ * up. The timeout may be reused or freed after this returns.
+ *
+ * @param timeout The timeout given to timeout_sleep_arm
+ *
+ * @return 1 if the thread was woken up by the timeout, 0 if it was
+ * woken up otherwise.
+ */
+int timeout_sleep_disarm(timeout_t *timeout)
+{
+    timeout_cancel(timeout);
+    return timeout->expired;
+}
+
+/** @} */
@@ -0,0 +1,75 @@
+/*
+ * Timeouts.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef BUENOS_KERNEL_TIMEOUT_H
+#define BUENOS_KERNEL_TIMEOUT_H
+
+#include "lib/types.h"
+#include "kernel/thread.h"
+
+/* Links of the circular lists in the timing wheel slots */
+typedef struct timeout_link_struct {
+    struct timeout_link_struct *next;
+    struct timeout_link_struct *prev;
+} timeout_link_t;
+
+/* A timeout. The structure is owned by the caller, which must keep
+   it in memory until it has expired or been cancelled. */
+typedef struct timeout_struct {
+    /* position in the timing wheel, must be the first field */
+    timeout_link_t link;
+    /* tick at which the timeout expires */
+    uint32_t expires;
+    /* nonzero while the timeout is in the timing wheel */
+    int pending;
+    /* called on expiry with interrupts disabled */
+    void (*func)(struct timeout_struct *timeout);
+
+    /* used by the timed sleep functions */
+    void *resource;
+    TID_t thread;
+    int expired;
+} timeout_t;
+
+void timeout_init(void);
+void timeout_add(timeout_t *timeout, uint32_t msec,
+                 void (*func)(timeout_t *timeout));
+int timeout_cancel(timeout_t *timeout);
+void timeout_tick(void);
+uint32_t timeout_next_tick(void);
+
+void timeout_sleep_arm(timeout_t *timeout, void *resource, uint32_t msec);
+int timeout_sleep_disarm(timeout_t *timeout);
+
+#endif /* BUENOS_KERNEL_TIMEOUT_H */
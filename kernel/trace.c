@@ -0,0 +1,288 @@
+/*
+ * Scheduler tracing.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "kernel/trace.h"
+#include "kernel/thread.h"
+#include "kernel/config.h"
+#include "kernel/spinlock.h"
+#include "kernel/interrupt.h"
+#include "kernel/assert.h"
+#include "kernel/kmalloc.h"
+#include "drivers/timer.h"
+#include "lib/libc.h"
+
+/** @name Scheduler tracing
+ *
+ * Each CPU records scheduling events in its own ring of
+ * CONFIG_SCHEDULER_TRACE_ENTRIES records: context switches from
+ * scheduler_schedule, sleeps and wakeups from the sleep queue, and
+ * thread creation and termination. When the ring is full the oldest
+ * records are overwritten. Records are timestamped with the CP0
+ * Count register of the recording CPU.
+ *
+ * A ring is written only by its own CPU with interrupts disabled, so
+ * its spinlock is contended only when the ring is read by another
+ * CPU. Reading consumes the records.
+ *
+ * In addition, the time each thread has spent running and waiting in
+ * a ready to run queue and the number of voluntary and involuntary
+ * switches are counted per thread. The counters are reset when the
+ * thread table entry is reused.
+ *
+ * @{
+ */
+
+extern thread_table_t *thread_table;
+extern int thread_table_size;
+
+/* Trace ring of one CPU */
+typedef struct {
+    spinlock_t slock;
+    /* number of records ever written */
+    uint32_t head;
+    /* number of the first unread record */
+    uint32_t tail;
+    trace_record_t records[CONFIG_SCHEDULER_TRACE_ENTRIES];
+} trace_ring_t;
+
+static trace_ring_t trace_rings[CONFIG_MAX_CPUS];
+
+/* Scheduling counters of one thread */
+typedef struct {
+    trace_thread_stats_t stats;
+    /* CP0 count when the thread was put in a ready to run queue */
+    uint32_t ready_since;
+} trace_thread_t;
+
+static trace_thread_t *trace_threads;
+
+/* CP0 count when the current thread of each CPU was switched in */
+static uint32_t trace_run_since[CONFIG_MAX_CPUS];
+
+/**
+ * Initializes the trace rings and allocates the per-thread counters.
+ * Must be called after thread_table_init and before the virtual
+ * memory system is initialized (uses kmalloc).
+ */
+void trace_init(void)
+{
+    int i;
+
+    for (i=0; i<CONFIG_MAX_CPUS; i++) {
+	spinlock_reset(&trace_rings[i].slock);
+	spinlock_stats_register(&trace_rings[i].slock);
+	trace_rings[i].head = 0;
+	trace_rings[i].tail = 0;
+	trace_run_since[i] = 0;
+    }
+
+    trace_threads = kmalloc(thread_table_size * sizeof(trace_thread_t));
+    memoryset(trace_threads, 0, thread_table_size * sizeof(trace_thread_t));
+}
+
+/**
+ * Appends a record to the trace ring of the calling CPU.
+ *
+ * @param event The event, one of TRACE_*
+ * @param prev The thread causing the event or switched out
+ * @param next The thread affected by the event or switched in,
+ * negative if none
+ */
+void trace_event(uint32_t event, int prev, int next)
+{
+    interrupt_status_t intr_status;
+    trace_ring_t *ring;
+    trace_record_t *record;
+    int this_cpu;
+
+    intr_status = _interrupt_disable();
+
+    this_cpu = _interrupt_getcpu();
+    ring = &trace_rings[this_cpu];
+
+    spinlock_acquire(&ring->slock);
+
+    record = &ring->records[ring->head % CONFIG_SCHEDULER_TRACE_ENTRIES];
+    record->timestamp = timer_get_ticks();
+    record->cpu       = this_cpu;
+    record->event     = event;
+    record->prev      = prev;
+    record->next      = next;
+
+    ring->head++;
+    if (ring->head - ring->tail > CONFIG_SCHEDULER_TRACE_ENTRIES)
+	ring->tail = ring->head - CONFIG_SCHEDULER_TRACE_ENTRIES;
+
+    spinlock_release(&ring->slock);
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Resets the counters of a new thread and records its creation.
+ *
+ * @param tid The created thread
+ */
+void trace_thread_create(int tid)
+{
+    KERNEL_ASSERT(tid >= 0 && tid < thread_table_size);
+
+    memoryset(&trace_threads[tid], 0, sizeof(trace_thread_t));
+    trace_event(TRACE_CREATE, thread_get_current_thread(), tid);
+}
+
+/**
+ * Marks the moment the given thread entered a ready to run
+ * queue. Called with interrupts disabled.
+ *
+ * @param tid The thread which became ready
+ */
+void trace_thread_ready(int tid)
+{
+    trace_threads[tid].ready_since = timer_get_ticks();
+}
+
+/**
+ * Accounts a scheduling decision of the calling CPU. The time since
+ * the previous decision is charged to the thread which was running.
+ * If another thread was selected, the switch is counted for the
+ * threads and recorded in the trace. Called by the scheduler with
+ * interrupts disabled.
+ *
+ * @param prev The thread which was running
+ * @param next The thread selected to run
+ * @param event Why prev stopped running, one of TRACE_SWITCH_*
+ */
+void trace_switch(int prev, int next, uint32_t event)
+{
+    int this_cpu;
+    uint32_t now;
+
+    this_cpu = _interrupt_getcpu();
+    now = timer_get_ticks();
+
+    trace_threads[prev].stats.runtime += now - trace_run_since[this_cpu];
+    trace_run_since[this_cpu] = now;
+
+    if (prev == next)
+	return;
+
+    if (event == TRACE_SWITCH_PREEMPT)
+	trace_threads[prev].stats.involuntary++;
+    else
+	trace_threads[prev].stats.voluntary++;
+
+    if (next != IDLE_THREAD_TID)
+	trace_threads[next].stats.waittime += 
+	    now - trace_threads[next].ready_since;
+
+    trace_event(event, prev, next);
+}
+
+/* Number of records copied at a time by trace_read */
+#define TRACE_READ_CHUNK 16
+
+/**
+ * Removes the oldest unread records from the trace ring of the given
+ * CPU and copies them to the given buffer. The records are copied
+ * out in small chunks so that the ring is not locked while the
+ * buffer (possibly in userland) is accessed.
+ *
+ * @param cpu The CPU whose trace is read
+ * @param buffer Where to copy the records
+ * @param count Maximum number of records to copy
+ *
+ * @return Number of records copied, negative if the CPU is invalid.
+ */
+int trace_read(int cpu, trace_record_t *buffer, int count)
+{
+    interrupt_status_t intr_status;
+    trace_ring_t *ring;
+    trace_record_t chunk[TRACE_READ_CHUNK];
+    int i, n, copied = 0;
+
+    if (cpu < 0 || cpu >= CONFIG_MAX_CPUS || count < 0)
+	return -1;
+
+    ring = &trace_rings[cpu];
+
+    while (copied < count) {
+	intr_status = _interrupt_disable();
+	spinlock_acquire(&ring->slock);
+
+	n = MIN(count - copied, TRACE_READ_CHUNK);
+	n = MIN(n, (int)(ring->head - ring->tail));
+	for (i=0; i<n; i++) {
+	    chunk[i] = ring->records[(ring->tail + i) 
+				     % CONFIG_SCHEDULER_TRACE_ENTRIES];
+	}
+	ring->tail += n;
+
+	spinlock_release(&ring->slock);
+	_interrupt_set_state(intr_status);
+
+	if (n == 0)
+	    break;
+
+	memcopy(n * sizeof(trace_record_t), &buffer[copied], chunk);
+	copied += n;
+    }
+
+    return copied;
+}
+
+/**
+ * Copies the scheduling counters of the given thread. The counters
+ * are updated without locking by the CPUs scheduling the thread, so
+ * the copy is not necessarily consistent.
+ *
+ * @param tid The thread
+ * @param stats Where to copy the counters
+ *
+ * @return 0 on success, 1 if there is no thread in the given thread
+ * table entry and negative if the thread ID is out of range.
+ */
+int trace_thread_stats(int tid, trace_thread_stats_t *stats)
+{
+    if (tid < 0 || tid >= thread_table_size)
+	return -1;
+
+    if (thread_table[tid].state == THREAD_FREE)
+	return 1;
+
+    *stats = trace_threads[tid].stats;
+
+    return 0;
+}
+
+/** @} */
@@ -0,0 +1,93 @@
+/*
+ * Scheduler tracing.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef BUENOS_KERNEL_TRACE_H
+#define BUENOS_KERNEL_TRACE_H
+
+#include "lib/types.h"
+
+/* This header is also included by userland programs, which read the
+   trace through the SYSCALL_TRACE_READ and SYSCALL_THREAD_STATS
+   system calls. */
+
+/* Trace events. The first three are context switches, the reason
+   being the state of the thread switched out. */
+#define TRACE_SWITCH_PREEMPT 1 /* still runnable (timeslice over,
+				  preempted or yielded) */
+#define TRACE_SWITCH_SLEEP   2 /* went to sleep */
+#define TRACE_SWITCH_EXIT    3 /* finished */
+#define TRACE_SLEEP          4 /* thread added to a sleep queue */
+#define TRACE_WAKE           5 /* thread woken from a sleep queue */
+#define TRACE_CREATE         6 /* thread created */
+#define TRACE_FINISH         7 /* thread called thread_finish */
+
+/* One record in the trace ring of a CPU */
+typedef struct {
+    /* CP0 Count register of the recording CPU */
+    uint32_t timestamp;
+    /* CPU which recorded the event */
+    uint16_t cpu;
+    /* TRACE_* event */
+    uint16_t event;
+    /* Thread switched out, going to sleep, waking the other thread,
+       creating the other thread or finishing */
+    int32_t prev;
+    /* Thread switched in, woken or created, negative if none */
+    int32_t next;
+} trace_record_t;
+
+/* Per-thread scheduling counters. Times are in CP0 cycles and wrap
+   around. */
+typedef struct {
+    /* time spent running */
+    uint32_t runtime;
+    /* time spent in a ready to run queue */
+    uint32_t waittime;
+    /* switches because the thread went to sleep or finished */
+    uint32_t voluntary;
+    /* switches while the thread was still runnable */
+    uint32_t involuntary;
+} trace_thread_stats_t;
+
+void trace_init(void);
+
+void trace_event(uint32_t event, int prev, int next);
+void trace_thread_create(int tid);
+void trace_thread_ready(int tid);
+void trace_switch(int prev, int next, uint32_t event);
+
+int trace_read(int cpu, trace_record_t *buffer, int count);
+int trace_thread_stats(int tid, trace_thread_stats_t *stats);
+
+#endif /* BUENOS_KERNEL_TRACE_H */
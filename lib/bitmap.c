@@ -129,6 +129,46 @@ void bitmap_set(bitmap_t *bitmap, int pos, int value)
 }
 
 
+/**
+ * Finds the first bit with the given value at or after a position.
+ * Whole words are skipped at a time, and the bit within a word is
+ * located with the CLZ instruction.
+ *
+ * @param bitmap The bitmap
+ *
+ * @param l Length of bitmap in bits
+ *
+ * @param pos The position to start from
+ *
+ * @param value The value (0 or 1) to look for
+ *
+ * @return The position of the bit, l if not found.
+ */
+static int bitmap_next(bitmap_t *bitmap, int l, int pos, int value)
+{
+    bitmap_t word;
+    int i;
+
+    if (pos >= l)
+        return l;
+
+    i = pos / 32;
+    word = value ? bitmap[i] : ~bitmap[i];
+    word &= 0xffffffff << (pos % 32);
+
+    while (word == 0) {
+        i++;
+        if (i * 32 >= l)
+            return l;
+        word = value ? bitmap[i] : ~bitmap[i];
+    }
+
+    /* word & -word isolates the lowest one bit */
+    pos = i * 32 + 31 - _bitmap_clz(word & -word);
+
+    return MIN(pos, l);
+}
+
 /**
  * Finds first zero and sets it to one.
  * 
@@ -141,35 +181,148 @@ void bitmap_set(bitmap_t *bitmap, int pos, int value)
 
 int bitmap_findnset(bitmap_t *bitmap, int l)
 {
-    int i,j;
+    return bitmap_findnset_from(bitmap, l, 0);
+}
+
+/**
+ * Finds the first zero at or after the given position and sets it
+ * to one. If there is none, the search continues from the beginning
+ * of the bitmap. Passing the position after the previously found
+ * bit gives next-fit allocation, which does not rescan the allocated
+ * bits at the start of the bitmap every time.
+ * 
+ * @param bitmap The bitmap
+ *
+ * @param l Length of bitmap in bits
+ *
+ * @param start The position to start the search from
+ * 
+ * @return Number of bit set. Negative if failed.
+ */
+
+int bitmap_findnset_from(bitmap_t *bitmap, int l, int start)
+{
+    int pos;
+
+    KERNEL_ASSERT(l >= 0 && start >= 0);
+
+    if (start >= l)
+        start = 0;
+
+    pos = bitmap_next(bitmap, l, start, 0);
+    if (pos >= l) {
+        /* wrap around */
+        pos = bitmap_next(bitmap, start, 0, 0);
+        if (pos >= start)
+            return -1;
+    }
+
+    bitmap[pos / 32] |= 1u << (pos % 32);
+    return pos;
+}
+
+/**
+ * Finds the first run of n consecutive zeros.
+ *
+ * @param bitmap The bitmap
+ *
+ * @param l Length of bitmap in bits
+ *
+ * @param n Length of the run, at least 1
+ *
+ * @return Position of the first bit of the run. Negative if not
+ * found.
+ */
+
+int bitmap_find_range(bitmap_t *bitmap, int l, int n)
+{
+    int pos = 0, end;
+
+    KERNEL_ASSERT(l >= 0 && n > 0);
+
+    for (;;) {
+        pos = bitmap_next(bitmap, l, pos, 0);
+        if (pos > l - n)
+            return -1;
+
+        end = bitmap_next(bitmap, l, pos, 1);
+        if (end - pos >= n)
+            return pos;
+
+        pos = end;
+    }
+}
+
+/**
+ * Sets a run of bits in the bitmap.
+ *
+ * @param bitmap The bitmap
+ *
+ * @param pos The index of the first bit to set
+ *
+ * @param n Number of bits to set
+ *
+ * @param value The new value of the bits. Valid values are 0 and 1.
+ */
+
+void bitmap_set_range(bitmap_t *bitmap, int pos, int n, int value)
+{
+    bitmap_t mask;
+    int i, bits;
+
+    KERNEL_ASSERT(pos >= 0 && n >= 0);
+
+    if (value != 0 && value != 1)
+        KERNEL_PANIC("bit value other than 0 or 1");
+
+    while (n > 0) {
+        i = pos / 32;
+        bits = MIN(n, 32 - pos % 32);
+        if (bits == 32)
+            mask = 0xffffffff;
+        else
+            mask = ((1u << bits) - 1) << (pos % 32);
+
+        if (value)
+            bitmap[i] |= mask;
+        else
+            bitmap[i] &= ~mask;
+
+        pos += bits;
+        n -= bits;
+    }
+}
+
+/**
+ * Counts the ones in the bitmap.
+ *
+ * @param bitmap The bitmap
+ *
+ * @param l Length of bitmap in bits
+ *
+ * @return The number of bits set to one.
+ */
+
+int bitmap_count(bitmap_t *bitmap, int l)
+{
+    bitmap_t word;
+    int i, count = 0;
 
     KERNEL_ASSERT(l >= 0);
 
-    /* Loop through words until a one with at least one free bit is found. */
-    for (i = 0; i < bitmap_sizeof(l)/4; i++) {
-	if (bitmap[i] != 0xffffffff) {
-	    /* At least one bit in this word is zero */
-	    int basepos=i*32; /* Bit position of the first bit in this word. */
-
-	    /* Loop through the bits in the word until the free bit is found.*/
-	    for (j = 0; j < 32; j++) {
-		if (bitmap_get(bitmap, basepos+j) == 0) {
-		    if (basepos+j >= l) {
-			/* we are in the last word in the bitmap, but
-			   it is not fully in use and the first "free"
-			   bit is in unused portion -> return "not found". */
-			return -1;
-		    }
-
-		    bitmap_set(bitmap, basepos+j, 1);
-		    return (basepos+j);
-		}
-	    }		
-	}
+    for (i = 0; i < (l + 31) / 32; i++) {
+        word = bitmap[i];
+        if (i == l / 32)
+            word &= (1u << (l % 32)) - 1;  /* the last, partial word */
+
+        /* Add up the bits in pairs, nibbles and bytes in parallel */
+        word = word - ((word >> 1) & 0x55555555);
+        word = (word & 0x33333333) + ((word >> 2) & 0x33333333);
+        word = (word + (word >> 4)) & 0x0f0f0f0f;
+        count += (word * 0x01010101) >> 24;
     }
-	
-    /* No free slots found */
-    return -1;
+
+    return count;
 }
 
 /** @} */
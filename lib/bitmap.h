@@ -46,5 +46,12 @@ void bitmap_init(bitmap_t *bitmap, int size);
 int bitmap_get(bitmap_t *bitmap, int pos);
 void bitmap_set(bitmap_t *bitmap, int pos, int value);
 int bitmap_findnset(bitmap_t *bitmap, int l);
+int bitmap_findnset_from(bitmap_t *bitmap, int l, int start);
+int bitmap_find_range(bitmap_t *bitmap, int l, int n);
+void bitmap_set_range(bitmap_t *bitmap, int pos, int n, int value);
+int bitmap_count(bitmap_t *bitmap, int l);
+
+/* Count leading zeros, see lib/_bitmap.S */
+uint32_t _bitmap_clz(uint32_t word);
 
 #endif /* BUENOS_LIB_BITMAP_H */
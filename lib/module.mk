@@ -3,6 +3,6 @@
 # Set the module name
 MODULE := lib
 
-FILES := libc.c xprintf.c rand.S bitmap.c debug.c
+FILES := libc.c xprintf.c rand.S bitmap.c _bitmap.S debug.c
 
 SRC += $(patsubst %, $(MODULE)/%, $(FILES))
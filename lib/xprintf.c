@@ -77,7 +77,7 @@
 static int vxnprintf(char*, int, const char*, va_list, int);
 
 
-spinlock_t kprintf_slock = 0;
+spinlock_t kprintf_slock;
 
 /* corresponding to vprintf(3) */
 int kvprintf(const char *fmt, va_list ap) {
@@ -172,8 +172,8 @@ void network_init(void)
 	    network_interfaces[i].mtu = gnd->frame_size(gnd);
 
             /* The network code is unable to handle frames which don't
-               fit into one page. This is because there is no way to
-               allocate two consecutive memory pages. */
+               fit into one page, since frames are single pages from
+               the page pool. */
 	    KERNEL_ASSERT(network_interfaces[i].mtu <= PAGE_SIZE);
 
 	    network_interfaces[i].address = gnd->hwaddr(gnd);
@@ -40,6 +40,7 @@
 #include "net/protocols.h"
 #include "kernel/config.h"
 #include "kernel/semaphore.h"
+#include "kernel/rwlock.h"
 #include "vm/pagepool.h"
 #include "kernel/panic.h"
 #include "kernel/assert.h"
@@ -50,7 +51,7 @@
 
 /* socket data from socket.c */
 extern socket_descriptor_t open_sockets[CONFIG_MAX_OPEN_SOCKETS];
-extern semaphore_t *open_sockets_sem;
+extern rwlock_t open_sockets_lock;
 
 /* input queue to hold incoming packets and a semaphore to synch access */
 static pop_queue_t pop_queue[CONFIG_POP_QUEUE_SIZE];
@@ -110,16 +111,16 @@ int socket_sendto(sock_t s,
 		   sizeof(pop_header_t)),
 	       PAGE_SIZE - sizeof(pop_header_t));
 
-    semaphore_P(open_sockets_sem);
+    rwlock_read_acquire(&open_sockets_lock);
 
     /* Check that it is a POP socket */
     if (open_sockets[s].protocol != PROTOCOL_POP) {
-	semaphore_V(open_sockets_sem);
+	rwlock_read_release(&open_sockets_lock);
 	return -1;
     }
     sport = open_sockets[s].port;
 
-    semaphore_V(open_sockets_sem);
+    rwlock_read_release(&open_sockets_lock);
 
     semaphore_P(pop_send_buffer_sem);
 
@@ -164,7 +165,11 @@ int socket_sendto(sock_t s,
  * @param maxlength Do not copy more than this amount of bytes
  * @param length    The number of bytes actually received is placed here
  *
- * @return The number of bytes received, or negative on error
+ * If a receive timeout has been set for the socket with
+ * socket_set_timeout, waits at most that long for the packet.
+ *
+ * @return The number of bytes received, SOCKET_TIMEOUT if the
+ * receive timed out, or other negative on error
  */
 int socket_recvfrom(sock_t s,
 		    network_address_t *addr,
@@ -173,6 +178,7 @@ int socket_recvfrom(sock_t s,
 		    int buflength,
 		    int *length)
 {
+    uint32_t timeout;
 
     /* check parameter sanity */
     KERNEL_ASSERT(s >= 0 && s < CONFIG_MAX_OPEN_SOCKETS);
@@ -180,17 +186,19 @@ int socket_recvfrom(sock_t s,
     KERNEL_ASSERT(buflength >= 1 && buf != NULL && addr != NULL && 
 		  sport != NULL && length != NULL);
 
-    semaphore_P(open_sockets_sem);
+    rwlock_write_acquire(&open_sockets_lock);
 
     /* either no POP socket or another recvfrom already in progress
      * (no queueing implemented)
      */
     if (open_sockets[s].protocol != PROTOCOL_POP ||
 	open_sockets[s].rbuf != NULL) {
-	semaphore_V(open_sockets_sem);
+	rwlock_write_release(&open_sockets_lock);
 	return -1;
     }
 
+    timeout = open_sockets[s].timeout;
+
     /* place the return value variables into the socket structure */
     open_sockets[s].rbuf = buf;
     open_sockets[s].bufsize = buflength;
@@ -198,8 +206,8 @@ int socket_recvfrom(sock_t s,
     open_sockets[s].copied = length;
     open_sockets[s].sport = sport;
 
-    /* release the semaphore */
-    semaphore_V(open_sockets_sem);
+    /* release the socket table */
+    rwlock_write_release(&open_sockets_lock);
 
     /* Note: no one can foul up the FIFO in
      * open_sockets[s].receive_complete between these two semaphore
@@ -212,8 +220,30 @@ int socket_recvfrom(sock_t s,
     semaphore_V(pop_service_thread_sem);
 
     /* and wait until the packet has arrived and been copied to our buffer */
+    if (timeout == 0) {
+	semaphore_P(open_sockets[s].receive_complete);
+	return *length;
+    }
+
+    if (semaphore_P_timeout(open_sockets[s].receive_complete, timeout))
+	return *length;
+
+    /* Timed out. Withdraw the request unless the service thread has
+       already taken it over, in which case the packet is on its way
+       and we wait for it after all. */
+    rwlock_write_acquire(&open_sockets_lock);
+    if (open_sockets[s].rbuf == buf && open_sockets[s].copied == length) {
+	open_sockets[s].rbuf = NULL;
+	open_sockets[s].bufsize = 0;
+	open_sockets[s].sender = NULL;
+	open_sockets[s].copied = NULL;
+	open_sockets[s].sport = NULL;
+	rwlock_write_release(&open_sockets_lock);
+	return SOCKET_TIMEOUT;
+    }
+    rwlock_write_release(&open_sockets_lock);
+
     semaphore_P(open_sockets[s].receive_complete);
-    
     return *length;
 }
 
@@ -260,6 +290,8 @@ void pop_init()
 	(pop_service_thread_sem == NULL)) {
 	KERNEL_PANIC("pop_init: semaphore allocation failed\n");
     }
+    semaphore_set_name(pop_send_buffer_sem, "pop_send_buffer");
+    semaphore_set_name(pop_queue_sem, "pop_queue");
 
 
     /* zero the POP queue entries */
@@ -361,6 +393,7 @@ int pop_push_frame(network_address_t fromaddr,
 #define POP_ACTION_NONE 0
 #define POP_ACTION_DISCARD 1
 #define POP_ACTION_TRANSFER 2
+#define POP_ACTION_RESCAN 3
 
 
 /** The service thread for incoming packets. This thread loops through
@@ -374,14 +407,14 @@ static void pop_service_thread(uint32_t UNUSED dummy)
 {
     int action, i, j, slot = 0;
     pop_header_t *f = NULL;
-    void UNUSED *wake;
+    socket_descriptor_t req;
 
     dummy = 0; /* prevent warning */
 
     /* loop the POP queue */
     while(1) {
 	/* lock the queue and the socket table */
-	semaphore_P(open_sockets_sem);
+	rwlock_read_acquire(&open_sockets_lock);
 	semaphore_P(pop_queue_sem);
 	
 	action = POP_ACTION_NONE;
@@ -429,7 +462,42 @@ static void pop_service_thread(uint32_t UNUSED dummy)
 
 	/* unlock the queue and the socket table */
 	semaphore_V(pop_queue_sem);
-	semaphore_V(open_sockets_sem);
+	rwlock_read_release(&open_sockets_lock);
+
+	/* Take over the pending recvfrom request, so that a recvfrom
+	 * timing out after this knows the transfer is in progress.
+	 * This modifies the socket, so the socket table is write
+	 * locked, and the request is checked again since it may have
+	 * been withdrawn while the table was unlocked.
+	 */
+	if (action == POP_ACTION_TRANSFER) {
+	    socket_descriptor_t *sock;
+
+	    rwlock_write_acquire(&open_sockets_lock);
+	    semaphore_P(pop_queue_sem);
+
+	    /* the socket may also have been closed and its slot
+	     * reopened on another port */
+	    sock = &open_sockets[pop_queue[slot].socket];
+	    if (sock->protocol == PROTOCOL_POP &&
+		sock->port == f->dest_port && sock->rbuf != NULL) {
+		req = *sock;
+		sock->rbuf = NULL;
+		sock->bufsize = 0;
+		sock->sender = NULL;
+		sock->copied = NULL;
+		sock->sport = NULL;
+	    } else {
+		/* withdrawn, leave the frame in the queue and look up
+		 * its recipient again, discarding it if there is none */
+		pop_queue[slot].busy = 0;
+		pop_queue[slot].socket = -1;
+		action = POP_ACTION_RESCAN;
+	    }
+
+	    semaphore_V(pop_queue_sem);
+	    rwlock_write_release(&open_sockets_lock);
+	}
 
 
 	/* the actions themselves are done here, where no locks are held */
@@ -447,31 +515,20 @@ static void pop_service_thread(uint32_t UNUSED dummy)
 	    int bytes;
 
 	    /* copy the payload */
-	    bytes = MIN(f->size, open_sockets[pop_queue[slot].socket].bufsize);
-	    memcopy(bytes,
-		    open_sockets[pop_queue[slot].socket].rbuf,
+	    bytes = MIN(f->size, req.bufsize);
+	    memcopy(bytes, req.rbuf,
 		    (void*)((uint32_t)f + sizeof(pop_header_t)));
 
 	    /* set return value variables */
-	    *(open_sockets[pop_queue[slot].socket].sender) = pop_queue[slot].from;
-	    *(open_sockets[pop_queue[slot].socket].copied) = bytes;
-	    *(open_sockets[pop_queue[slot].socket].sport) = f->source_port;
-	    
-	    /* save the receive buffer address */
-	    wake = open_sockets[pop_queue[slot].socket].rbuf;
-
-	    /* zero the return value variables from the socket */
-	    open_sockets[pop_queue[slot].socket].rbuf = NULL;
-	    open_sockets[pop_queue[slot].socket].bufsize = 0;
-	    open_sockets[pop_queue[slot].socket].sender = NULL;
-	    open_sockets[pop_queue[slot].socket].copied = NULL;
-	    open_sockets[pop_queue[slot].socket].sport = NULL;
+	    *(req.sender) = pop_queue[slot].from;
+	    *(req.copied) = bytes;
+	    *(req.sport) = f->source_port;
 
 	    /* discard the frame */
 	    network_free_frame(f);
 
 	    /* wake the caller of recvfrom */
-	    semaphore_V(open_sockets[pop_queue[slot].socket].receive_complete);
+	    semaphore_V(req.receive_complete);
 
 	    /* This will mark the queue slot as free. No synch needed,
 	     * since this is only one write operation. 
@@ -39,17 +39,18 @@
 #include "net/protocols.h"
 #include "kernel/config.h"
 #include "kernel/semaphore.h"
+#include "kernel/rwlock.h"
 #include "kernel/panic.h"
 #include "kernel/assert.h"
 #include "vm/pagepool.h"
 #include "lib/types.h"
 
-/* open socket table and a semaphore to synch access to it */
+/* open socket table and a reader-writer lock to synch access to it */
 socket_descriptor_t open_sockets[CONFIG_MAX_OPEN_SOCKETS];
-semaphore_t *open_sockets_sem;
+rwlock_t open_sockets_lock;
 
 
-/** Initializes the socket system. Creates the semaphore and sets
+/** Initializes the socket system. Resets the table lock and sets
  *  the open socket table entries to null values.
  */
 void socket_init()
@@ -62,11 +63,8 @@ void socket_init()
     init_done = 1;
 
 
-    open_sockets_sem = semaphore_create(1);
-
-    if (open_sockets_sem == NULL) {
-	KERNEL_PANIC("socket_init: semaphore allocation failed\n");
-    }
+    rwlock_reset(&open_sockets_lock);
+    rwlock_set_name(&open_sockets_lock, "open_sockets");
 
     /* init socket table */
     for (i=0; i<CONFIG_MAX_OPEN_SOCKETS; i++) {
@@ -78,6 +76,7 @@ void socket_init()
 	open_sockets[i].copied = NULL;
 	open_sockets[i].sport = NULL;
 	open_sockets[i].receive_complete = NULL;
+	open_sockets[i].timeout = 0;
     }
 
 }
@@ -103,7 +102,7 @@ sock_t socket_open(uint8_t protocol, uint16_t port)
     if (protocol != PROTOCOL_POP && protocol != PROTOCOL_SOP)
 	return -1;
 
-    semaphore_P(open_sockets_sem);
+    rwlock_write_acquire(&open_sockets_lock);
 
     /* find an empty slot from the table */
     for (i=0; i<CONFIG_MAX_OPEN_SOCKETS; i++) {
@@ -113,7 +112,7 @@ sock_t socket_open(uint8_t protocol, uint16_t port)
 
     /* socket table full, return error */
     if (i == CONFIG_MAX_OPEN_SOCKETS) {
-	semaphore_V(open_sockets_sem);
+	rwlock_write_release(&open_sockets_lock);
 	return -1;
     }
     s = i;
@@ -141,7 +140,7 @@ sock_t socket_open(uint8_t protocol, uint16_t port)
 	for (i=0; i<CONFIG_MAX_OPEN_SOCKETS; i++) {
 	    if (open_sockets[i].protocol != 0 &&
 		open_sockets[i].port == port) {
-		semaphore_V(open_sockets_sem);
+		rwlock_write_release(&open_sockets_lock);
 		return -1;
 	    }
 	}
@@ -150,7 +149,7 @@ sock_t socket_open(uint8_t protocol, uint16_t port)
     /* allocate the signaling semaphore*/
     open_sockets[s].receive_complete = semaphore_create(0);
     if (open_sockets[s].receive_complete == NULL) {
-	semaphore_V(open_sockets_sem);
+	rwlock_write_release(&open_sockets_lock);
 	return -1;
     }
 
@@ -161,8 +160,9 @@ sock_t socket_open(uint8_t protocol, uint16_t port)
     open_sockets[s].bufsize = 0;
     open_sockets[s].sender = NULL;
     open_sockets[s].copied = NULL;
+    open_sockets[s].timeout = 0;
 
-    semaphore_V(open_sockets_sem);
+    rwlock_write_release(&open_sockets_lock);
 
     return s;
 }
@@ -178,7 +178,7 @@ void socket_close(sock_t socket)
     /* check sanity */
     KERNEL_ASSERT(socket >= 0 && socket < CONFIG_MAX_OPEN_SOCKETS);
 
-    semaphore_P(open_sockets_sem);
+    rwlock_write_acquire(&open_sockets_lock);
 
     /* zero the entry if it is an open socket */
     if (open_sockets[socket].receive_complete != NULL) {
@@ -193,5 +193,23 @@ void socket_close(sock_t socket)
 	open_sockets[socket].receive_complete = NULL;
     }
 
-    semaphore_V(open_sockets_sem);
+    rwlock_write_release(&open_sockets_lock);
+}
+
+
+/** Set the receive timeout of the given socket. A socket_recvfrom
+ * on the socket returns SOCKET_TIMEOUT if no packet arrives within
+ * the timeout.
+ *
+ * @param socket The socket
+ * @param msec The timeout in milliseconds, 0 to wait forever
+ */
+void socket_set_timeout(sock_t socket, uint32_t msec)
+{
+    /* check sanity */
+    KERNEL_ASSERT(socket >= 0 && socket < CONFIG_MAX_OPEN_SOCKETS);
+
+    rwlock_write_acquire(&open_sockets_lock);
+    open_sockets[socket].timeout = msec;
+    rwlock_write_release(&open_sockets_lock);
 }
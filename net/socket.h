@@ -47,6 +47,9 @@
  */
 typedef int sock_t; 
 
+/* socket_recvfrom return value when the receive timeout expired */
+#define SOCKET_TIMEOUT -2
+
 
 /* Open socket structure */
 typedef struct {
@@ -60,6 +63,8 @@ typedef struct {
     network_address_t *sender;     /* sender's address stored here */
     int *copied;                   /* bytes copied stored here */
     uint16_t *sport;               /* sender's port stored here */
+
+    uint32_t timeout;              /* receive timeout in ms, 0 = none */
 } socket_descriptor_t;
 
 
@@ -67,6 +72,7 @@ typedef struct {
 void socket_init();
 sock_t socket_open(uint8_t protocol, uint16_t port);
 void socket_close(sock_t socket);
+void socket_set_timeout(sock_t socket, uint32_t msec);
 int socket_sendto(sock_t s,
 		  network_address_t addr,
 		  uint16_t dport,
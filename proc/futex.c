@@ -0,0 +1,190 @@
+/*
+ * Futexes.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "proc/futex.h"
+#include "kernel/thread.h"
+#include "kernel/sleepq.h"
+#include "kernel/spinlock.h"
+#include "kernel/interrupt.h"
+#include "vm/vm.h"
+#include "vm/pagepool.h"
+
+/** @name Futexes
+ *
+ * A futex is an aligned 32-bit word in userland memory on which
+ * userland threads can sleep. Userland synchronization primitives
+ * built on futexes change the word with atomic instructions and
+ * enter the kernel only to sleep when they have to wait and to wake
+ * up sleepers, so uncontended operations need no system calls.
+ *
+ * A futex is identified by its address space and user virtual
+ * address. The pair is resolved through the pagetable of the calling
+ * thread to the physical address of the word, which is unique across
+ * address spaces and stays the same when the address space gets a
+ * new ASID. The physical address is used as the sleep queue
+ * resource. Kernel objects are referenced by their kernel segment
+ * addresses, which are above 0x80000000, so the keys never collide.
+ *
+ * futex_wait checks the value of the word and goes to the sleep
+ * queue while holding a spinlock hashed from the key, and futex_wake
+ * takes the same spinlock before waking. A waker which changes the
+ * word before calling futex_wake therefore either makes the waiter
+ * see the new value or finds it in the sleep queue, and no wakeup is
+ * lost. The futex spinlocks are taken before the sleep queue bucket
+ * spinlocks.
+ *
+ * @{
+ */
+
+/* Number of futex spinlocks (prime number) */
+#define FUTEX_HASHTABLE_SIZE 31
+
+/* Hash function used to select the spinlock of a futex */
+#define FUTEX_HASH(key) (((key) >> 2) % FUTEX_HASHTABLE_SIZE)
+
+/* Spinlocks serializing the value check of futex_wait against
+   futex_wake */
+static spinlock_t futex_slocks[FUTEX_HASHTABLE_SIZE];
+
+/**
+ * Initializes the futex spinlocks.
+ */
+void futex_init(void)
+{
+    int i;
+
+    for (i = 0; i < FUTEX_HASHTABLE_SIZE; i++) {
+	spinlock_reset(&futex_slocks[i]);
+	spinlock_stats_register(&futex_slocks[i]);
+    }
+}
+
+/**
+ * Returns the physical address of the futex at the given user address
+ * in the address space of the current thread, or 0 if the address is
+ * not a valid futex address.
+ *
+ * @param uaddr Userland virtual address of the futex
+ */
+static uint32_t futex_key(uint32_t uaddr)
+{
+    pagetable_t *pagetable = thread_get_current_thread_entry()->pagetable;
+
+    if (pagetable == NULL || (uaddr & 0x3) != 0 || uaddr >= 0x80000000)
+	return 0;
+
+    return vm_translate(pagetable, uaddr);
+}
+
+/**
+ * Puts the current thread to sleep on the futex at the given address
+ * if the futex holds the expected value. The caller must check the
+ * state it is waiting for after being woken up, since it may also
+ * have been woken up for other reasons.
+ *
+ * @param uaddr Userland virtual address of the futex
+ * @param expected The value the futex must have for the thread to
+ * sleep
+ *
+ * @return FUTEX_OK after the thread has been woken up,
+ * FUTEX_WOULDBLOCK if the futex did not hold the expected value or
+ * FUTEX_INVALID if uaddr is not a valid futex address.
+ */
+int futex_wait(uint32_t uaddr, int expected)
+{
+    interrupt_status_t intr_status;
+    spinlock_t *slock;
+    uint32_t key;
+
+    key = futex_key(uaddr);
+    if (key == 0)
+	return FUTEX_INVALID;
+
+    slock = &futex_slocks[FUTEX_HASH(key)];
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(slock);
+
+    /* Read the word through the unmapped kernel segment, so no TLB
+       exception can happen while the spinlock is held. */
+    if (*(volatile int *)ADDR_PHYS_TO_KERNEL(key) != expected) {
+	spinlock_release(slock);
+	_interrupt_set_state(intr_status);
+	return FUTEX_WOULDBLOCK;
+    }
+
+    sleepq_add((void *)key);
+    spinlock_release(slock);
+    thread_switch();
+
+    _interrupt_set_state(intr_status);
+    return FUTEX_OK;
+}
+
+/**
+ * Wakes up at most count threads sleeping on the futex at the given
+ * address.
+ *
+ * @param uaddr Userland virtual address of the futex
+ * @param count Maximum number of threads to wake up
+ *
+ * @return The number of threads woken up, or FUTEX_INVALID if uaddr
+ * is not a valid futex address.
+ */
+int futex_wake(uint32_t uaddr, int count)
+{
+    interrupt_status_t intr_status;
+    spinlock_t *slock;
+    uint32_t key;
+    int woken = 0;
+
+    key = futex_key(uaddr);
+    if (key == 0)
+	return FUTEX_INVALID;
+
+    slock = &futex_slocks[FUTEX_HASH(key)];
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(slock);
+
+    while (woken < count && sleepq_wake((void *)key))
+	woken++;
+
+    spinlock_release(slock);
+    _interrupt_set_state(intr_status);
+
+    return woken;
+}
+
+/** @} */
@@ -4,7 +4,7 @@
 MODULE := proc
 
 
-FILES := exception.c elf.c process.c syscall.c
+FILES := exception.c elf.c process.c syscall.c futex.c
 
 SRC += $(patsubst %, $(MODULE)/%, $(FILES))
 
@@ -44,24 +44,46 @@
 #include "drivers/yams.h"
 #include "vm/vm.h"
 #include "vm/pagepool.h"
+#include "vm/asid.h"
 #include "kernel/sleepq.h"
+#include "kernel/completion.h"
 
 
 /** @name Process startup
  *
  * This module contains a function to start a userland process.
+ *
+ * A process may run several threads, created by process_fork, in
+ * the same address space. Each thread has its own userland stack.
+ * The stacks are placed below the stack of the initial thread,
+ * separated by an unmapped guard page. A stack is mapped when it is
+ * first used and stays mapped until the process ends, so it can be
+ * reused by later threads.
  */
 
+/* Distance between the userland stacks of the threads of a process */
+#define PROCESS_STACK_STRIDE ((CONFIG_USERLAND_STACK_SIZE + 1) * PAGE_SIZE)
+
+/* Initial stack pointer of the thread using the given stack */
+#define PROCESS_STACK_TOP(slot) \
+    (USERLAND_STACK_TOP - (slot) * PROCESS_STACK_STRIDE)
+
 process_table_t process_table[PROCESS_MAX_PROCESSES];
 
 spinlock_t process_table_slock;
 
 void process_reset(process_id_t pid)
 {
+    int i;
+
     process_table[pid].state         = PROCESS_FREE;
     process_table[pid].executable[0] = 0;
     process_table[pid].retval        = 0;
     process_table[pid].cFiles        = 0;
+    process_table[pid].threads       = 0;
+    process_table[pid].stacks_mapped = 0;
+    for (i = 0; i < PROCESS_MAX_THREADS; i++)
+        process_table[pid].stack_owner[i] = -1;
 }
 
 /* Initialize process table and spinlock */
@@ -69,8 +91,12 @@ void process_init()
 {
     int i;
     spinlock_reset(&process_table_slock);
-    for (i = 0; i <= PROCESS_MAX_PROCESSES; ++i)
+    spinlock_stats_register(&process_table_slock);
+    for (i = 0; i < PROCESS_MAX_PROCESSES; ++i) {
+        spinlock_reset(&process_table[i].mem_slock);
+        spinlock_stats_register(&process_table[i].mem_slock);
         process_reset(i);
+    }
 }
 
 /* Find a free slot in the process table. Returns PROCESS_MAX_PROCESSES
@@ -82,7 +108,7 @@ process_id_t alloc_process_id()
 
     intr_status = _interrupt_disable();
     spinlock_acquire(&process_table_slock);
-    for (i = 0; i <= PROCESS_MAX_PROCESSES; ++i)
+    for (i = 0; i < PROCESS_MAX_PROCESSES; ++i)
     {
         if (process_table[i].state == PROCESS_FREE)
         {
@@ -96,14 +122,39 @@ process_id_t alloc_process_id()
 }
 
 
+/* Allocates a zeroed page and maps it writable at vaddr. Returns 0
+   on success, -1 if out of memory, in which case nothing is mapped. */
+static int process_map_page(pagetable_t *pagetable, uint32_t vaddr)
+{
+    uint32_t phys_page;
+
+    phys_page = pagepool_get_zeroed_page();
+    if (phys_page == 0)
+        return -1;
+
+    if (vm_map(pagetable, phys_page, vaddr, 1) != 0) {
+        pagepool_free_phys_page(phys_page);
+        return -1;
+    }
+    return 0;
+}
+
+/* Ends a process that ran out of memory while process_start was
+   loading it. Does not return. */
+static void process_start_failed(openfile_t file)
+{
+    vfs_close(file);
+    process_finish(-1);
+}
+
 /**
  * Starts one userland process. The thread calling this function will
  * be used to run the process and will therefore never return from
  * this function. This function asserts that no errors occur in
  * process startup (the executable file exists and is a valid ecoff
- * file, enough memory is available, file operations succeed...).
- * Therefore this function is not suitable to allow startup of
- * arbitrary processes.
+ * file, file operations succeed...), except that running out of
+ * memory ends the process with return value -1. Therefore this
+ * function is not suitable to allow startup of arbitrary processes.
  *
  * @executable The name of the executable to be run in the userland
  * process
@@ -112,9 +163,7 @@ void process_start(process_id_t pid)
 {
     thread_table_t *my_entry;
     pagetable_t *pagetable;
-    uint32_t phys_page;
     context_t user_context;
-    uint32_t stack_bottom;
     elf_info_t elf;
     openfile_t file;
     char *executable;
@@ -127,20 +176,25 @@ void process_start(process_id_t pid)
     my_entry->process_id = pid;
     executable = process_table[pid].executable;
 
+    /* This is the initial thread of the process, using stack 0 */
+    process_table[pid].threads = 1;
+    process_table[pid].stack_owner[0] = thread_get_current_thread();
+    process_table[pid].stacks_mapped = 1;
+
     /* If the pagetable of this thread is not NULL, we are trying to
        run a userland process for a second time in the same thread.
        This is not possible. */
     KERNEL_ASSERT(my_entry->pagetable == NULL);
 
-    pagetable = vm_create_pagetable(thread_get_current_thread());
+    pagetable = vm_create_pagetable();
     KERNEL_ASSERT(pagetable != NULL);
 
     intr_status = _interrupt_disable();
     my_entry->pagetable = pagetable;
 
-    /* Update TLB to allow access to the virtual addresses of the
-       segments. */
-    _tlb_set_asid(thread_get_current_thread());
+    /* Give the new address space an ASID and update TLB to allow
+       access to the virtual addresses of the segments. */
+    asid_activate(pagetable);
 
     _interrupt_set_state(intr_status);
 
@@ -152,18 +206,11 @@ void process_start(process_id_t pid)
     /* Trivial and naive sanity check for entry point: */
     KERNEL_ASSERT(elf.entry_point >= PAGE_SIZE);
 
-    /* Calculate the number of pages needed by the whole process
-       (including userland stack). Since we don't have proper tlb
-       handling code, all these pages must fit into TLB. */
-    KERNEL_ASSERT(elf.ro_pages + elf.rw_pages + CONFIG_USERLAND_STACK_SIZE
-            <= _tlb_get_maxindex() + 1);
-
     /* Allocate and map stack */
     for(i = 0; i < CONFIG_USERLAND_STACK_SIZE; i++) {
-        phys_page = pagepool_get_phys_page();
-        KERNEL_ASSERT(phys_page != 0);
-        vm_map(my_entry->pagetable, phys_page,
-                (USERLAND_STACK_TOP & PAGE_SIZE_MASK) - i*PAGE_SIZE, 1);
+        if (process_map_page(my_entry->pagetable,
+                (USERLAND_STACK_TOP & PAGE_SIZE_MASK) - i*PAGE_SIZE) != 0)
+            process_start_failed(file);
     }
 
     /* Put the mapped pages into TLB. Here we again assume that the
@@ -179,17 +226,15 @@ void process_start(process_id_t pid)
        segments begin at page boundary. (The linker script in tests
        directory creates this kind of segments) */
     for(i = 0; i < (int)elf.ro_pages; i++) {
-        phys_page = pagepool_get_phys_page();
-        KERNEL_ASSERT(phys_page != 0);
-        vm_map(my_entry->pagetable, phys_page,
-                elf.ro_vaddr + i*PAGE_SIZE, 1);
+        if (process_map_page(my_entry->pagetable,
+                elf.ro_vaddr + i*PAGE_SIZE) != 0)
+            process_start_failed(file);
     }
 
     for(i = 0; i < (int)elf.rw_pages; i++) {
-        phys_page = pagepool_get_phys_page();
-        KERNEL_ASSERT(phys_page != 0);
-        vm_map(my_entry->pagetable, phys_page,
-                elf.rw_vaddr + i*PAGE_SIZE, 1);
+        if (process_map_page(my_entry->pagetable,
+                elf.rw_vaddr + i*PAGE_SIZE) != 0)
+            process_start_failed(file);
     }
 
     /* Initialize heap pointer */
@@ -198,18 +243,11 @@ void process_start(process_id_t pid)
     if (heap_end % PAGE_SIZE == 0) {
         /* In the unlikely event that the heap should start on the 
            first address of a page we must allocate that page. */
-        uint32_t phys_page = pagepool_get_phys_page();
-        KERNEL_ASSERT(phys_page != 0);
-        vm_map(pagetable, phys_page, heap_end, 1);
+        if (process_map_page(pagetable, heap_end) != 0)
+            process_start_failed(file);
     }
 
-    /* Zero the pages. */
-    memoryset((void *)elf.ro_vaddr, 0, elf.ro_pages*PAGE_SIZE);
-    memoryset((void *)elf.rw_vaddr, 0, elf.rw_pages*PAGE_SIZE);
-
-    stack_bottom = (USERLAND_STACK_TOP & PAGE_SIZE_MASK) -
-        (CONFIG_USERLAND_STACK_SIZE-1)*PAGE_SIZE;
-    memoryset((void *)stack_bottom, 0, CONFIG_USERLAND_STACK_SIZE*PAGE_SIZE);
+    /* The segment and stack pages were allocated zeroed. */
 
     /* Copy segments */
 
@@ -309,23 +347,200 @@ int process_join(process_id_t pid)
     return retval;
 }
 
+/* Arguments passed from process_fork to the new thread */
+typedef struct {
+    process_id_t pid;
+    pagetable_t *pagetable;
+    context_t user_context;
+    completion_t started;
+} process_fork_args_t;
+
+/* Maps the given userland stack of a process, unless it has already
+   been mapped. Pages mapped before running out of memory stay mapped
+   and are skipped on the next attempt. The caller must have reserved
+   the stack. Returns 0 on success, -1 if out of memory. */
+static int process_map_stack(process_id_t pid, pagetable_t *pagetable,
+                             int slot)
+{
+    interrupt_status_t intr_status;
+    uint32_t vaddr;
+    int i, r = 0;
+
+    /* Other threads of the process may be mapping heap pages */
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table[pid].mem_slock);
+
+    if (process_table[pid].stacks_mapped & (1 << slot)) {
+        spinlock_release(&process_table[pid].mem_slock);
+        _interrupt_set_state(intr_status);
+        return 0;
+    }
+
+    for (i = 0; i < CONFIG_USERLAND_STACK_SIZE; i++) {
+        vaddr = (PROCESS_STACK_TOP(slot) & PAGE_SIZE_MASK) - i*PAGE_SIZE;
+        if (vm_translate(pagetable, vaddr) != 0)
+            continue;
+
+        if (process_map_page(pagetable, vaddr) != 0) {
+            r = -1;
+            break;
+        }
+    }
+
+    if (r == 0)
+        process_table[pid].stacks_mapped |= (1 << slot);
+
+    spinlock_release(&process_table[pid].mem_slock);
+    _interrupt_set_state(intr_status);
+    return r;
+}
+
+/* Entry point of threads created by process_fork. Joins the address
+   space of the forking thread and enters userland. */
+static void process_fork_start(uint32_t arg)
+{
+    process_fork_args_t *args = (process_fork_args_t *)arg;
+    thread_table_t *my_entry;
+    context_t user_context;
+    interrupt_status_t intr_status;
+
+    my_entry = thread_get_current_thread_entry();
+    my_entry->process_id = args->pid;
+    user_context = args->user_context;
+
+    intr_status = _interrupt_disable();
+    my_entry->pagetable = args->pagetable;
+    asid_activate(my_entry->pagetable);
+    _interrupt_set_state(intr_status);
+
+    /* The arguments are on the stack of the forking thread, which
+       returns after this. */
+    completion_complete(&args->started);
+
+    thread_goto_userland(&user_context);
+
+    KERNEL_PANIC("thread_goto_userland failed.");
+}
+
+/**
+ * Starts a new thread in the process of the calling thread. The new
+ * thread shares the address space of the process and gets a
+ * userland stack of its own.
+ *
+ * @param entry Userland address where the thread starts
+ * @param arg Passed to the thread in register a0
+ * @param ret Return address of the thread (register ra)
+ *
+ * @return 0 on success, PROCESS_FORK_FAILED if the process has
+ * PROCESS_MAX_THREADS threads or resources ran out.
+ */
+int process_fork(uint32_t entry, uint32_t arg, uint32_t ret)
+{
+    process_fork_args_t args;
+    process_id_t pid = process_get_current_process();
+    TID_t my_tid = thread_get_current_thread();
+    interrupt_status_t intr_status;
+    TID_t tid;
+    int slot;
+
+    args.pid = pid;
+    args.pagetable = thread_get_current_thread_entry()->pagetable;
+    completion_reset(&args.started);
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table_slock);
+
+    /* Reserve a stack, marking it ours until the thread exists */
+    for (slot = 1; slot < PROCESS_MAX_THREADS; slot++) {
+        if (process_table[pid].stack_owner[slot] < 0)
+            break;
+    }
+    if (slot == PROCESS_MAX_THREADS) {
+        spinlock_release(&process_table_slock);
+        _interrupt_set_state(intr_status);
+        return PROCESS_FORK_FAILED;
+    }
+    process_table[pid].stack_owner[slot] = my_tid;
+
+    spinlock_release(&process_table_slock);
+    _interrupt_set_state(intr_status);
+
+    /* The stack is mapped without the process table locked, since
+       it may take a while */
+    if (process_map_stack(pid, args.pagetable, slot) != 0) {
+        intr_status = _interrupt_disable();
+        spinlock_acquire(&process_table_slock);
+        process_table[pid].stack_owner[slot] = -1;
+        spinlock_release(&process_table_slock);
+        _interrupt_set_state(intr_status);
+        return PROCESS_FORK_FAILED;
+    }
+
+    memoryset(&args.user_context, 0, sizeof(args.user_context));
+    args.user_context.cpu_regs[MIPS_REGISTER_SP] = PROCESS_STACK_TOP(slot);
+    args.user_context.cpu_regs[MIPS_REGISTER_A0] = arg;
+    args.user_context.cpu_regs[MIPS_REGISTER_RA] = ret;
+    args.user_context.pc = entry;
+
+    tid = thread_create(&process_fork_start, (uint32_t)&args);
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table_slock);
+
+    if (tid < 0) {
+        process_table[pid].stack_owner[slot] = -1;
+    } else {
+        process_table[pid].stack_owner[slot] = tid;
+        process_table[pid].threads++;
+    }
+
+    spinlock_release(&process_table_slock);
+    _interrupt_set_state(intr_status);
+
+    if (tid < 0)
+        return PROCESS_FORK_FAILED;
+
+    thread_run(tid);
+    completion_wait(&args.started);
+
+    return 0;
+}
+
 void process_finish(int retval)
 {
     interrupt_status_t intr_status;
     process_id_t cur = process_get_current_process();
+    TID_t my_tid = thread_get_current_thread();
     thread_table_t *thread = thread_get_current_thread_entry();
+    int i;
 
     intr_status = _interrupt_disable();
     spinlock_acquire(&process_table_slock);
 
-    process_table[cur].state  = PROCESS_ZOMBIE;
-    process_table[cur].retval = retval;
+    /* The return value of the process is that of its initial thread,
+       the one using stack 0, whichever thread exits last. */
+    if (process_table[cur].stack_owner[0] == my_tid)
+        process_table[cur].retval = retval;
 
-    /* Remember to destroy the pagetable! */
-    vm_destroy_pagetable(thread->pagetable);
-    thread->pagetable = NULL;
+    /* Release the userland stack of this thread */
+    for (i = 0; i < PROCESS_MAX_THREADS; i++) {
+        if (process_table[cur].stack_owner[i] == my_tid)
+            process_table[cur].stack_owner[i] = -1;
+    }
+
+    /* The process ends with its last thread */
+    process_table[cur].threads--;
+    if (process_table[cur].threads == 0) {
+        process_table[cur].state = PROCESS_ZOMBIE;
 
-    sleepq_wake_all(&process_table[cur]);
+        /* Remember to destroy the pagetable! */
+        vm_destroy_pagetable(thread->pagetable);
+
+        sleepq_wake_all(&process_table[cur]);
+    }
+    thread->pagetable = NULL;
+    /* The pagetable may be gone, keep the TLB refill off it */
+    asid_activate(NULL);
 
     spinlock_release(&process_table_slock);
     _interrupt_set_state(intr_status);
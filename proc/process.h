@@ -38,15 +38,18 @@
 #define BUENOS_PROC_PROCESS
 
 #include "lib/types.h"
+#include "kernel/spinlock.h"
 
 #define USERLAND_STACK_TOP 0x7fffeffc
 
 #define PROCESS_PTABLE_FULL  -1
 #define PROCESS_ILLEGAL_JOIN -2
+#define PROCESS_FORK_FAILED  -3
 
 #define PROCESS_MAX_FILELENGTH 256
 #define PROCESS_MAX_PROCESSES  128
 #define PROCESS_MAX_FILES      10
+#define PROCESS_MAX_THREADS    16
 
 typedef int process_id_t;
 
@@ -66,6 +69,19 @@ typedef struct {
   int files[PROCESS_MAX_FILES];
 
   uint32_t heap_end;
+  /* Protects heap_end and the mappings in the pagetable shared by
+     the threads of the process. Never held together with
+     process_table_slock. */
+  spinlock_t mem_slock;
+
+  /* Number of threads running in the process */
+  int threads;
+  /* TID of the thread using each userland stack, negative if none.
+     Stack 0 is the stack of the initial thread. */
+  int stack_owner[PROCESS_MAX_THREADS];
+  /* Bitmap of the stacks which have been mapped, protected by
+     mem_slock */
+  uint32_t stacks_mapped;
 } process_table_t;
 
 /* Initialize the process table */
@@ -77,7 +93,13 @@ process_id_t process_spawn(const char *executable);
 process_id_t process_get_current_process(void);
 process_table_t *process_get_current_process_entry(void);
 
-/* Stop the process and the thread it runs in. Sets the return value as well */
+/* Start a new thread in the current process. It begins at entry with
+ * arg in a0 and ret in ra. Returns 0, or PROCESS_FORK_FAILED. */
+int process_fork(uint32_t entry, uint32_t arg, uint32_t ret);
+
+/* Stop the thread calling this. The return value of the process is
+ * the retval given by its initial thread. The process ends when its
+ * last thread stops. */
 void process_finish(int retval);
 
 /* Wait for the given process to terminate, returning its return value. This
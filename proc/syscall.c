@@ -39,12 +39,18 @@
 #include "kernel/panic.h"
 #include "lib/libc.h"
 #include "kernel/assert.h"
+#include "kernel/interrupt.h"
 #include "proc/process.h"
 #include "drivers/device.h"
 #include "drivers/gcd.h"
 #include "fs/vfs.h"
 #include "vm/pagetable.h"
 #include "kernel/thread.h"
+#include "kernel/trace.h"
+#include "kernel/bench.h"
+#include "kernel/config.h"
+#include "proc/futex.h"
+#include "drivers/timer.h"
 #include "vm/pagepool.h"
 #include "vm/vm.h"
 
@@ -94,17 +100,12 @@ process_id_t syscall_exec(const char *filename)
     return process_spawn(filename);
 }
 
-void *syscall_memlimit(void *heap_end)
+/* Moves the heap end of the process to new_heap_end, mapping a page
+   if needed. Called with the memory spinlock of the process held. */
+static void *syscall_set_heap_end(process_table_t *process,
+                                  pagetable_t *pagetable,
+                                  uint32_t new_heap_end)
 {
-  process_table_t *process;
-  process = process_get_current_process_entry();
-  thread_table_t *thread;
-  thread = thread_get_current_thread_entry();
-  uint32_t new_heap_end = (uint32_t) heap_end;
-
-  /* If the new heap end is NULL, returns current heap end. */
-  if (heap_end == NULL) return (void *)process->heap_end;
-
   /* Check if new heap_end is lower than the current. */
   if (process->heap_end > new_heap_end) return NULL;
 
@@ -119,18 +120,43 @@ void *syscall_memlimit(void *heap_end)
 
   /* Check if there is enough space on current page. */
   if (diff <= 0) {
-    /* Check if the thread is allowed to allocate a new page. */
-    if (thread->pagetable->valid_count >= PAGETABLE_ENTRIES) return NULL;
-    
     /* Retrieve the address of a free physical page and map it to the new page. */
     uint32_t phys_page = pagepool_get_phys_page();
-    KERNEL_ASSERT(phys_page != 0);
-    vm_map(thread->pagetable, phys_page, new_heap_end, 1);    
+    if (phys_page == 0) return NULL;
+    /* Mapping may need a page for the pagetable as well */
+    if (vm_map(pagetable, phys_page, new_heap_end, 1) != 0) {
+      pagepool_free_phys_page(phys_page);
+      return NULL;
+    }
   }
   process->heap_end = new_heap_end;
   return (void *) new_heap_end;
 }
 
+void *syscall_memlimit(void *heap_end)
+{
+  process_table_t *process;
+  process = process_get_current_process_entry();
+  thread_table_t *thread;
+  thread = thread_get_current_thread_entry();
+  interrupt_status_t intr_status;
+  void *result;
+
+  /* If the new heap end is NULL, returns current heap end. */
+  if (heap_end == NULL) return (void *)process->heap_end;
+
+  /* Other threads of the process may be growing the heap or mapping
+     stacks in the same pagetable. */
+  intr_status = _interrupt_disable();
+  spinlock_acquire(&process->mem_slock);
+  result = syscall_set_heap_end(process, thread->pagetable,
+                                (uint32_t) heap_end);
+  spinlock_release(&process->mem_slock);
+  _interrupt_set_state(intr_status);
+
+  return result;
+}
+
 /**
  * Handle system calls. Interrupts are enabled when this function is
  * called.
@@ -175,6 +201,38 @@ void syscall_handle(context_t *user_context)
             user_context->cpu_regs[MIPS_REGISTER_V0] =
                 syscall_exec((char *)A1);
             break;
+        case SYSCALL_FORK:
+            user_context->cpu_regs[MIPS_REGISTER_V0] =
+                process_fork(A1, A2, A3);
+            break;
+        case SYSCALL_TRACE_READ:
+            user_context->cpu_regs[MIPS_REGISTER_V0] =
+                trace_read(A1, (trace_record_t *)A2, A3);
+            break;
+        case SYSCALL_THREAD_STATS:
+            user_context->cpu_regs[MIPS_REGISTER_V0] =
+                trace_thread_stats(A1, (trace_thread_stats_t *)A2);
+            break;
+        case SYSCALL_BENCH:
+#if CONFIG_BENCH
+            user_context->cpu_regs[MIPS_REGISTER_V0] =
+                bench_run(A1, A2, A3);
+#else
+            user_context->cpu_regs[MIPS_REGISTER_V0] = 0;
+#endif
+            break;
+        case SYSCALL_FUTEX_WAIT:
+            user_context->cpu_regs[MIPS_REGISTER_V0] =
+                futex_wait(A1, A2);
+            break;
+        case SYSCALL_FUTEX_WAKE:
+            user_context->cpu_regs[MIPS_REGISTER_V0] =
+                futex_wake(A1, A2);
+            break;
+        case SYSCALL_CYCLES:
+            user_context->cpu_regs[MIPS_REGISTER_V0] =
+                timer_get_ticks();
+            break;
         default:
             KERNEL_PANIC("Unhandled system call\n");
     }
@@ -55,6 +55,13 @@
 #define SYSCALL_CREATE    0x206
 #define SYSCALL_DELETE    0x207
 
+#define SYSCALL_TRACE_READ   0x301
+#define SYSCALL_THREAD_STATS 0x302
+#define SYSCALL_BENCH        0x303
+#define SYSCALL_FUTEX_WAIT   0x304
+#define SYSCALL_FUTEX_WAKE   0x305
+#define SYSCALL_CYCLES       0x306
+
 /* When userland program reads or writes these already open files it
  * actually accesses the console.
  */
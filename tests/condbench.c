@@ -0,0 +1,33 @@
+/*
+ * Userland condition variable broadcast benchmark
+ *
+ * Runs the kernel condition variable benchmark with an increasing
+ * number of consumer threads, up to 16. In each round the producer
+ * wakes all consumers with one broadcast while holding the lock, so
+ * the cost of a broadcast grows with the number of waiters. Run it
+ * with 2 to 4 CPUs in yams.conf.
+ */
+
+#include "tests/lib.h"
+
+#define ROUNDS 200
+
+int main(void)
+{
+  uint32_t cycles;
+  int threads;
+
+  puts("consumers  broadcasts      items     cycles  cycles/item\n");
+  for (threads = 1; threads <= 16; threads *= 2) {
+    cycles = syscall_bench(BENCH_CONDVAR, threads, ROUNDS);
+    if (cycles == 0) {
+      printf("%9d benchmark failed\n", threads);
+      continue;
+    }
+    printf("%9d %11d %10d %10u %12u\n", threads, ROUNDS,
+           threads * ROUNDS, cycles, cycles / (threads * ROUNDS));
+  }
+
+  syscall_exit(0);
+  return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * Userland futex mutex contention benchmark
+ *
+ * Starts an increasing number of threads with syscall_fork, each
+ * entering a short critical section protected by one futex-based
+ * mutex, and prints the cycles used per critical section. With one
+ * thread the mutex is never contended and no system calls are made
+ * in the loop. Run it with 2 to 4 CPUs in yams.conf.
+ */
+
+#include "tests/lib.h"
+
+#define ROUNDS 2000
+#define MAX_THREADS 6
+
+static mutex_t mutex;
+static int counter;
+
+static mutex_t done_mutex;
+static cond_t done_cond;
+static int finished;
+
+static void worker(int rounds)
+{
+  int i;
+
+  for (i = 0; i < rounds; i++) {
+    mutex_lock(&mutex);
+    counter++;
+    mutex_unlock(&mutex);
+  }
+
+  mutex_lock(&done_mutex);
+  finished++;
+  cond_signal(&done_cond);
+  mutex_unlock(&done_mutex);
+}
+
+int main(void)
+{
+  uint32_t start, cycles;
+  int threads, i;
+
+  mutex_init(&mutex);
+  mutex_init(&done_mutex);
+  cond_init(&done_cond);
+
+  puts("threads  sections     cycles  cycles/section\n");
+  for (threads = 1; threads <= MAX_THREADS; threads++) {
+    counter = 0;
+    finished = 0;
+
+    start = syscall_cycles();
+    for (i = 0; i < threads; i++) {
+      if (syscall_fork(&worker, ROUNDS) < 0) {
+        break;
+      }
+    }
+
+    mutex_lock(&done_mutex);
+    while (finished < i) {
+      cond_wait(&done_cond, &done_mutex);
+    }
+    mutex_unlock(&done_mutex);
+    cycles = syscall_cycles() - start;
+
+    if (i < threads) {
+      printf("%7d fork failed\n", threads);
+      break;
+    }
+    if (counter != threads * ROUNDS) {
+      printf("%7d counter is %d, expected %d\n", threads, counter,
+             threads * ROUNDS);
+      continue;
+    }
+    printf("%7d %9d %10u %15u\n", threads, threads * ROUNDS, cycles,
+           cycles / (threads * ROUNDS));
+  }
+
+  syscall_exit(0);
+  return 0;
+}
@@ -94,6 +94,14 @@ int syscall_join(pid_t pid)
 }
 
 
+/* Threads created by syscall_fork return here from their start
+ * function.
+ */
+static void fork_return(void)
+{
+  syscall_exit(0);
+}
+
 /* Create a new thread running in the same address space as the
  * caller. The thread is started at function 'func', and the thread
  * will end when 'func' returns. 'arg' is passed as an argument to
@@ -101,7 +109,8 @@ int syscall_join(pid_t pid)
  */
 int syscall_fork(void (*func)(int), int arg)
 {
-  return (int)_syscall(SYSCALL_FORK, (uint32_t)func, (uint32_t)arg, 0);
+  return (int)_syscall(SYSCALL_FORK, (uint32_t)func, (uint32_t)arg,
+                       (uint32_t)&fork_return);
 }
 
 
@@ -183,6 +192,67 @@ int syscall_delete(const char *filename)
   return (int)_syscall(SYSCALL_DELETE, (uint32_t)filename, 0, 0);
 }
 
+
+/* Remove at most 'count' of the oldest records from the scheduler
+ * trace of CPU 'cpu' and copy them to 'buffer'. Returns the number
+ * of records copied, or a negative value if there is no such CPU.
+ */
+int syscall_trace_read(int cpu, trace_record_t *buffer, int count)
+{
+  return (int)_syscall(SYSCALL_TRACE_READ, (uint32_t)cpu, (uint32_t)buffer,
+                       (uint32_t)count);
+}
+
+
+/* Copy the scheduling counters of thread 'tid' to 'stats'. Returns 0
+ * on success, 1 if there is no such thread and a negative value if
+ * 'tid' is beyond the end of the thread table.
+ */
+int syscall_thread_stats(int tid, trace_thread_stats_t *stats)
+{
+  return (int)_syscall(SYSCALL_THREAD_STATS, (uint32_t)tid,
+                       (uint32_t)stats, 0);
+}
+
+
+/* Run the kernel benchmark 'bench' (BENCH_*) with 'threads' threads
+ * or thread pairs, each doing 'rounds' iterations. Returns the
+ * elapsed CPU cycles, or 0 on error.
+ */
+uint32_t syscall_bench(int bench, int threads, int rounds)
+{
+  return _syscall(SYSCALL_BENCH, (uint32_t)bench, (uint32_t)threads,
+                  (uint32_t)rounds);
+}
+
+
+/* Sleep on the futex 'addr' if it still contains 'expected'. Returns
+ * 0 when woken up, or a negative value if the futex did not contain
+ * 'expected' or 'addr' is invalid. Wakeups may be spurious.
+ */
+int syscall_futex_wait(volatile int *addr, int expected)
+{
+  return (int)_syscall(SYSCALL_FUTEX_WAIT, (uint32_t)addr,
+                       (uint32_t)expected, 0);
+}
+
+
+/* Wake at most 'count' threads sleeping on the futex 'addr'. Returns
+ * the number of threads woken up, or a negative value on error.
+ */
+int syscall_futex_wake(volatile int *addr, int count)
+{
+  return (int)_syscall(SYSCALL_FUTEX_WAKE, (uint32_t)addr,
+                       (uint32_t)count, 0);
+}
+
+
+/* Return the cycle counter of the CPU running the caller. */
+uint32_t syscall_cycles(void)
+{
+  return _syscall(SYSCALL_CYCLES, 0, 0, 0);
+}
+
 /* The following functions are not system calls, but convenient
    library functions inspired by POSIX and the C standard library. */
 
@@ -845,3 +915,84 @@ int atoi(const char *nptr)
 }
 
 #endif
+
+#ifdef PROVIDE_SYNCHRONIZATION
+
+/* Mutexes and condition variables for threads created with
+   syscall_fork. They are built on futexes: the fast paths only use
+   atomic instructions, and the kernel is entered only to sleep and
+   to wake up sleepers.
+
+   A mutex is 0 when unlocked, 1 when locked and 2 when locked and
+   there may be threads sleeping on it. A condition variable is a
+   sequence number which is incremented on every signal; a waiter
+   sleeps only if the number has not changed since it released the
+   mutex. */
+
+void mutex_init(mutex_t *mutex)
+{
+  mutex->state = 0;
+}
+
+void mutex_lock(mutex_t *mutex)
+{
+  int c;
+
+  c = _atomic_cas(&mutex->state, 0, 1);
+  if (c == 0) {
+    return;
+  }
+
+  /* Contended: mark the mutex as having sleepers and sleep until it
+     is released. */
+  if (c != 2) {
+    c = _atomic_swap(&mutex->state, 2);
+  }
+  while (c != 0) {
+    syscall_futex_wait(&mutex->state, 2);
+    c = _atomic_swap(&mutex->state, 2);
+  }
+}
+
+void mutex_unlock(mutex_t *mutex)
+{
+  if (_atomic_add(&mutex->state, -1) != 1) {
+    /* There may be sleepers */
+    mutex->state = 0;
+    syscall_futex_wake(&mutex->state, 1);
+  }
+}
+
+void cond_init(cond_t *cond)
+{
+  cond->seq = 0;
+}
+
+void cond_wait(cond_t *cond, mutex_t *mutex)
+{
+  int seq = cond->seq;
+
+  mutex_unlock(mutex);
+  syscall_futex_wait(&cond->seq, seq);
+
+  /* Other threads may have been woken up at the same time, so take
+     the mutex as contended to make sure they will be woken up when
+     it is released. */
+  while (_atomic_swap(&mutex->state, 2) != 0) {
+    syscall_futex_wait(&mutex->state, 2);
+  }
+}
+
+void cond_signal(cond_t *cond)
+{
+  _atomic_add(&cond->seq, 1);
+  syscall_futex_wake(&cond->seq, 1);
+}
+
+void cond_broadcast(cond_t *cond)
+{
+  _atomic_add(&cond->seq, 1);
+  syscall_futex_wake(&cond->seq, 0x7fffffff);
+}
+
+#endif
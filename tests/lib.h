@@ -47,11 +47,14 @@
 #define PROVIDE_FORMATTED_OUTPUT
 #define PROVIDE_HEAP_ALLOCATOR
 #define PROVIDE_MISC
+#define PROVIDE_SYNCHRONIZATION
 
 #include <stdarg.h>
 #include <stddef.h>
 
 #include "lib/types.h"
+#include "kernel/trace.h"
+#include "kernel/bench.h"
 
 #define MIN(arg1,arg2) ((arg1) > (arg2) ? (arg2) : (arg1))
 #define MAX(arg1,arg2) ((arg1) > (arg2) ? (arg1) : (arg2))
@@ -73,6 +76,11 @@ typedef int32_t pid_t;
 /* Makes the syscall 'syscall_num' with the arguments 'a1', 'a2' and 'a3'. */
 uint32_t _syscall(uint32_t syscall_num, uint32_t a1, uint32_t a2, uint32_t a3);
 
+/* Atomic operations on 'addr'. Each returns the previous value. */
+int _atomic_cas(volatile int *addr, int old, int new);
+int _atomic_swap(volatile int *addr, int new);
+int _atomic_add(volatile int *addr, int delta);
+
 /* The library functions which are just wrappers to the _syscall function. */
 
 void syscall_halt(void);
@@ -93,6 +101,13 @@ int syscall_delete(const char *filename);
 int syscall_fork(void (*func)(int), int arg);
 void *syscall_memlimit(void *heap_end);
 
+int syscall_trace_read(int cpu, trace_record_t *buffer, int count);
+int syscall_thread_stats(int tid, trace_thread_stats_t *stats);
+uint32_t syscall_bench(int bench, int threads, int rounds);
+int syscall_futex_wait(volatile int *addr, int expected);
+int syscall_futex_wake(volatile int *addr, int count);
+uint32_t syscall_cycles(void);
+
 #ifdef PROVIDE_STRING_FUNCTIONS
 size_t strlen(const char *s);
 char *strcpy(char *dest, const char *src);
@@ -133,4 +148,22 @@ void *realloc(void *ptr, size_t size);
 int atoi(const char *nptr);
 #endif
 
+#ifdef PROVIDE_SYNCHRONIZATION
+typedef struct {
+  volatile int state;
+} mutex_t;
+
+typedef struct {
+  volatile int seq;
+} cond_t;
+
+void mutex_init(mutex_t *mutex);
+void mutex_lock(mutex_t *mutex);
+void mutex_unlock(mutex_t *mutex);
+void cond_init(cond_t *cond);
+void cond_wait(cond_t *cond, mutex_t *mutex);
+void cond_signal(cond_t *cond);
+void cond_broadcast(cond_t *cond);
+#endif
+
 #endif /* BUENOS_USERLAND_LIB_H */
@@ -0,0 +1,33 @@
+/*
+ * Userland lock_t contention benchmark
+ *
+ * Runs the kernel lock benchmark with an increasing number of
+ * threads entering a short critical section protected by one
+ * lock_t. Run it with 2 to 4 CPUs in yams.conf, and with
+ * CONFIG_LOCK_SPIN_LIMIT set to 0 for comparison with a lock that
+ * always sleeps.
+ */
+
+#include "tests/lib.h"
+
+#define ROUNDS 2000
+
+int main(void)
+{
+  uint32_t cycles;
+  int threads;
+
+  puts("threads  sections     cycles  cycles/section\n");
+  for (threads = 1; threads <= 8; threads++) {
+    cycles = syscall_bench(BENCH_LOCK, threads, ROUNDS);
+    if (cycles == 0) {
+      printf("%7d benchmark failed\n", threads);
+      continue;
+    }
+    printf("%7d %9d %10u %15u\n", threads, threads * ROUNDS, cycles,
+           cycles / (threads * ROUNDS));
+  }
+
+  syscall_exit(0);
+  return 0;
+}
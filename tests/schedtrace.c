@@ -0,0 +1,53 @@
+/*
+ * Userland scheduler trace dump
+ *
+ * Prints the scheduler trace records of every CPU and the scheduling
+ * counters of every thread. Times are in CPU cycles.
+ */
+
+#include "tests/lib.h"
+
+#define RECORDS 32
+
+static const char *events[] = {
+  "?", "preempt", "sleep", "exit", "block", "wake", "create", "finish"
+};
+
+static trace_record_t records[RECORDS];
+
+static void dump_cpu(int cpu)
+{
+  int i, n;
+
+  while ((n = syscall_trace_read(cpu, records, RECORDS)) > 0) {
+    for (i = 0; i < n; i++) {
+      printf("%10u cpu%u %-8s %4d -> %4d\n",
+             records[i].timestamp, records[i].cpu,
+             records[i].event <= TRACE_FINISH ? events[records[i].event]
+                                              : "?",
+             records[i].prev, records[i].next);
+    }
+  }
+}
+
+int main(void)
+{
+  trace_thread_stats_t stats;
+  int cpu, tid, ret;
+
+  puts("  timestamp cpu  event    prev -> next\n");
+  for (cpu = 0; syscall_trace_read(cpu, records, 0) >= 0; cpu++) {
+    dump_cpu(cpu);
+  }
+
+  puts("\n tid    runtime   waittime  voluntary involuntary\n");
+  for (tid = 0; (ret = syscall_thread_stats(tid, &stats)) >= 0; tid++) {
+    if (ret == 0) {
+      printf("%4d %10u %10u %10u %10u\n", tid, stats.runtime,
+             stats.waittime, stats.voluntary, stats.involuntary);
+    }
+  }
+
+  syscall_exit(0);
+  return 0;
+}
@@ -0,0 +1,32 @@
+/*
+ * Userland semaphore ping-pong benchmark
+ *
+ * Runs the kernel semaphore ping-pong benchmark with an increasing
+ * number of thread pairs. Each round trip is two sleeps and two
+ * wakeups, so the cost per round trip shows how well blocking and
+ * waking scales with the number of CPUs.
+ */
+
+#include "tests/lib.h"
+
+#define ROUNDS 1000
+
+int main(void)
+{
+  uint32_t cycles;
+  int pairs;
+
+  puts("pairs     rounds     cycles  cycles/round\n");
+  for (pairs = 1; pairs <= BENCH_MAX_THREADS; pairs *= 2) {
+    cycles = syscall_bench(BENCH_SEM_PINGPONG, pairs, ROUNDS);
+    if (cycles == 0) {
+      printf("%5d benchmark failed\n", pairs);
+      continue;
+    }
+    printf("%5d %10d %10u %13u\n", pairs, pairs * ROUNDS, cycles,
+           cycles / (pairs * ROUNDS));
+  }
+
+  syscall_exit(0);
+  return 0;
+}
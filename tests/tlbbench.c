@@ -0,0 +1,62 @@
+/*
+ * Userland TLB miss benchmark
+ *
+ * Grows the heap by PAGES pages and touches one word in every other
+ * page, so that each touch is to a different page pair. With more
+ * pairs than the TLB has rows nearly every touch misses in the TLB.
+ * The same number of touches to the first few pairs only, which stay
+ * in the TLB, gives the cost of the loop itself. The difference is
+ * the cost of the TLB misses. Multiply the misses per million cycles
+ * by the clock frequency in MHz (see yams.conf) to get misses per
+ * second.
+ */
+
+#include "tests/lib.h"
+
+#define PAGE_SIZE 4096
+#define PAGES     256
+#define PASSES    16
+#define RESIDENT  4    /* pairs touched in the resident run */
+
+static uint32_t touch(volatile int *base, int pairs, int touches)
+{
+  uint32_t start;
+  int i;
+
+  start = syscall_cycles();
+  for (i = 0; i < touches; i++)
+    base[(i % pairs) * 2 * PAGE_SIZE / sizeof(int)]++;
+  return syscall_cycles() - start;
+}
+
+int main(void)
+{
+  uint32_t heap, resident, missing, per_miss;
+  int i, touches;
+
+  /* The heap grows one page at a time, from a page boundary */
+  heap = (uint32_t)syscall_memlimit(NULL);
+  heap = (heap | (PAGE_SIZE - 1)) + 1;
+  for (i = 0; i < PAGES; i++) {
+    if (syscall_memlimit((void *)(heap + i * PAGE_SIZE)) == NULL) {
+      printf("could not grow the heap to %d pages\n", i);
+      syscall_exit(1);
+    }
+  }
+
+  /* Map all the pages before measuring */
+  touches = PAGES / 2;
+  touch((volatile int *)heap, PAGES / 2, touches);
+
+  touches = PASSES * PAGES / 2;
+  resident = touch((volatile int *)heap, RESIDENT, touches);
+  missing = touch((volatile int *)heap, PAGES / 2, touches);
+
+  per_miss = (missing - resident) / touches;
+  puts("   touches   resident    missing  cycles/miss  misses/Mcycle\n");
+  printf("%10d %10u %10u %12u %14u\n", touches, resident, missing,
+         per_miss, per_miss ? 1000000 / per_miss : 0);
+
+  syscall_exit(0);
+  return 0;
+}
@@ -0,0 +1,161 @@
+/*
+ * ASID allocator.
+ *
+ * Copyright (C) 2003 Juha Aatrokoski, Timo Lilja,
+ *   Leena Salmela, Teemu Takanen, Aleksi Virtanen.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior
+ *    written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "vm/asid.h"
+#include "vm/tlb.h"
+#include "kernel/config.h"
+#include "kernel/spinlock.h"
+#include "kernel/interrupt.h"
+#include "kernel/assert.h"
+
+/** @name ASID allocator
+ *
+ * Hands out the 8-bit hardware address space identifiers to
+ * pagetables. ASIDs are given out in order within a generation. When
+ * all of them have been used, a new generation is started and every
+ * CPU flushes its TLB before it next activates a pagetable. A
+ * pagetable whose ASID is from an old generation gets a new ASID the
+ * next time it is activated.
+ *
+ * Since an ASID is never handed out twice within a generation, TLB
+ * entries can safely survive context switches, and a new address
+ * space never sees the TLB entries of a dead one.
+ *
+ * @{
+ */
+
+/* Current generation. Generation 0 is never used, so a pagetable
+   with ASID 0 is always stale. */
+static uint32_t asid_generation;
+
+/* Next free hardware ASID in the current generation */
+static uint32_t asid_next;
+
+/* Set for each CPU which must flush its TLB before using an ASID
+   of the current generation */
+static int asid_flush_pending[CONFIG_MAX_CPUS];
+
+/* Spinlock protecting the allocator state above */
+static spinlock_t asid_slock;
+
+/**
+ * Initializes the ASID allocator.
+ */
+void asid_init(void)
+{
+    int i;
+
+    spinlock_reset(&asid_slock);
+    spinlock_stats_register(&asid_slock);
+    asid_generation = 1;
+    asid_next = 1;
+
+    for (i = 0; i < CONFIG_MAX_CPUS; i++)
+	asid_flush_pending[i] = 0;
+}
+
+/**
+ * Allocates a new ASID of the current generation for the given
+ * pagetable, starting a new generation if the current one is used
+ * up. The ASID spinlock must be held.
+ *
+ * @param pagetable Pagetable to give an ASID to
+ */
+static void asid_new(pagetable_t *pagetable)
+{
+    int i;
+
+    if (asid_next >= ASID_HW_COUNT) {
+	/* Rollover: ASIDs of the previous generation may still be in
+	   the TLBs of all CPUs. */
+	asid_generation++;
+	asid_next = 1;
+	for (i = 0; i < CONFIG_MAX_CPUS; i++)
+	    asid_flush_pending[i] = 1;
+    }
+
+    pagetable->ASID = (asid_generation << 8) | asid_next;
+    asid_next++;
+}
+
+/**
+ * Makes the given pagetable the active address space on this CPU by
+ * loading its ASID into the CP0 EntryHi register and making it the
+ * pagetable of the TLB refill handler. A new ASID is
+ * allocated if the pagetable does not have one from the current
+ * generation, and the TLB is flushed if this CPU has not done so
+ * since the last generation rollover. Must be called with interrupts
+ * disabled.
+ *
+ * @param pagetable Pagetable to activate, NULL for kernel threads
+ */
+void asid_activate(pagetable_t *pagetable)
+{
+    int this_cpu;
+
+    this_cpu = _interrupt_getcpu();
+    tlb_current_pagetable[this_cpu] = pagetable;
+
+    if (pagetable == NULL) {
+	_tlb_set_asid(0);
+	return;
+    }
+
+    /* Fast path: the ASID is still valid on this CPU. If a rollover
+       happens right after this check, the flush is only postponed to
+       the next activation, which is before any other address space
+       can run here. */
+    if (ASID_GENERATION(pagetable->ASID) == asid_generation
+	&& !asid_flush_pending[this_cpu]) {
+	_tlb_set_asid(ASID_HW(pagetable->ASID));
+	return;
+    }
+
+    spinlock_acquire(&asid_slock);
+
+    if (ASID_GENERATION(pagetable->ASID) != asid_generation)
+	asid_new(pagetable);
+
+    if (asid_flush_pending[this_cpu]) {
+	asid_flush_pending[this_cpu] = 0;
+	spinlock_release(&asid_slock);
+	tlb_flush();
+    } else {
+	spinlock_release(&asid_slock);
+    }
+
+    _tlb_set_asid(ASID_HW(pagetable->ASID));
+}
+
+/** @} */
@@ -35,22 +35,78 @@
  */
 
 #include "vm/pagepool.h"
-#include "lib/bitmap.h"
 #include "kernel/kmalloc.h"
 #include "kernel/spinlock.h"
 #include "kernel/interrupt.h"
 #include "kernel/assert.h"
+#include "kernel/config.h"
+#include "kernel/thread.h"
+#include "kernel/sleepq.h"
+#include "lib/libc.h"
 
 /** @name Page pool
  *
  * Functions and data structures for handling physical page reservation.
  *
+ * Physical memory is managed with a buddy allocator. Free memory is
+ * kept in blocks of 2^order pages, order 0 to
+ * CONFIG_PAGEPOOL_MAX_ORDER, each aligned on its own size. There is
+ * a free list for each order. An allocation takes a block from the
+ * list of the smallest sufficient order, splitting a larger block
+ * in halves if needed and putting the unused halves (buddies) to the
+ * lists of the lower orders. A freed block is merged with its buddy
+ * as long as the buddy is also free, and the merged block is put to
+ * the list of its order.
+ *
+ * The free lists are doubly linked through the first words of the
+ * free blocks themselves. The state of each page is kept in a byte:
+ * the first page of a free block records the order of the block and
+ * a free flag, the first page of an allocated block its order.
+ *
+ * pagepool_get_phys_page and pagepool_free_phys_page allocate and
+ * free single pages (order 0). Since these are by far the most common
+ * requests, each CPU keeps a small cache of free single pages in
+ * front of the buddy allocator. The cache has its own spinlock, which
+ * is only contended when another CPU is out of memory. Only when the
+ * cache runs empty or full are half of its pages moved from or to the
+ * free lists under pagepool_slock. Pages in the caches are not merged
+ * into larger blocks until drained, so an allocation which finds the
+ * free lists empty drains the caches of all CPUs and tries again
+ * before failing.
+ *
+ * A background thread, started with pagepool_start_zeroer, keeps up
+ * to CONFIG_PAGEPOOL_ZEROED_PAGES pages filled with zeros. The pages
+ * are taken from the page pool while it has plenty of free memory,
+ * which mostly gives pages freed recently. When the pool is full or
+ * memory is short the thread sleeps. It is woken when zeroed pages
+ * are taken or pages are freed while the pool is below half full and
+ * memory is plentiful. pagepool_get_zeroed_page hands the pages out,
+ * zeroing a page itself only when the pool is empty.
+ * Single page allocations fall back to the zeroed pages when the
+ * free lists run out.
+ *
  * @{
  */
 
-/* Bitmap field of physical pages. Length is number of physical pages
-   rounded up to a word boundary */
-static bitmap_t *pagepool_free_pages;
+/* Links of a free block, stored at the start of the block */
+typedef struct pagepool_block_struct {
+    struct pagepool_block_struct *next;
+    struct pagepool_block_struct *prev;
+} pagepool_block_t;
+
+/* Page state: order of the block starting at the page, with
+   PAGEPOOL_FREE set if the block is free. Other pages of a block are
+   PAGEPOOL_TAIL. Single pages in the per-CPU caches are
+   PAGEPOOL_CACHED. */
+#define PAGEPOOL_FREE   0x80
+#define PAGEPOOL_TAIL   0x7f
+#define PAGEPOOL_CACHED 0x7e
+
+/* Free lists of each order */
+static pagepool_block_t *pagepool_free_lists[CONFIG_PAGEPOOL_MAX_ORDER + 1];
+
+/* State of each physical page */
+static uint8_t *pagepool_page_state;
 
 /* Number of physical pages */
 static int pagepool_num_pages;
@@ -63,35 +119,145 @@ static int pagepool_num_free_pages;
    purpose).  */
 static int pagepool_static_end;
 
-/* Spinlock to handle synchronous access to pagepool_free_pages */
+/* Spinlock to handle synchronous access to the free lists */
 static spinlock_t pagepool_slock;
 
+/* Per-CPU cache of free single pages */
+typedef struct {
+    /* protects the cache, acquired before pagepool_slock */
+    spinlock_t slock;
+    /* number of pages in the cache */
+    int count;
+    /* page numbers of the cached pages */
+    int pages[CONFIG_PAGEPOOL_CACHE_SIZE];
+
+    /* single page allocations served from the cache */
+    uint32_t hits;
+    /* refills of the cache from the free lists */
+    uint32_t refills;
+    /* drains of the cache to the free lists */
+    uint32_t drains;
+} pagepool_cache_t;
+
+static pagepool_cache_t pagepool_caches[CONFIG_MAX_CPUS];
+
+/* Number of pages moved between a cache and the free lists at once */
+#define PAGEPOOL_BATCH ((CONFIG_PAGEPOOL_CACHE_SIZE + 1) / 2)
+
+/* Page numbers of pre-zeroed pages, protected by pagepool_zeroed_slock.
+   The pages cannot be linked through themselves, since that would
+   break the zeros. */
+static int pagepool_zeroed[CONFIG_PAGEPOOL_ZEROED_PAGES];
+static int pagepool_zeroed_count;
+static spinlock_t pagepool_zeroed_slock;
+
+/* Zeroed page requests served from and missing the zeroed pages */
+static uint32_t pagepool_zeroed_hits;
+static uint32_t pagepool_zeroed_misses;
+
+/* Nonzero while the zeroing thread sleeps, protected by
+   pagepool_zeroed_slock. The thread sleeps on this variable. */
+static int pagepool_zeroer_sleeping;
+
+/* Nonzero if the zeroing thread should be running: the zeroed pages
+   are below the low watermark and there is plenty of free memory.
+   Evaluated with pagepool_zeroed_slock held. */
+#define PAGEPOOL_ZEROER_NEEDED()					\
+    (pagepool_zeroed_count < CONFIG_PAGEPOOL_ZEROED_PAGES / 2		\
+     && pagepool_num_free_pages > CONFIG_PAGEPOOL_ZEROED_PAGES)
+
+/* Returns the free list links of the block starting at page i */
+#define PAGEPOOL_BLOCK(i) \
+    ((pagepool_block_t *)ADDR_PHYS_TO_KERNEL((uint32_t)(i) * PAGE_SIZE))
+
+/* Returns the first page of the block */
+#define PAGEPOOL_PAGE(block) \
+    ((int)(ADDR_KERNEL_TO_PHYS((uint32_t)(block)) / PAGE_SIZE))
+
+/* Puts the free block starting at page i to the list of the order */
+static void pagepool_push(int i, int order)
+{
+    pagepool_block_t *block = PAGEPOOL_BLOCK(i);
+
+    block->prev = NULL;
+    block->next = pagepool_free_lists[order];
+    if (block->next != NULL)
+	block->next->prev = block;
+    pagepool_free_lists[order] = block;
+
+    pagepool_page_state[i] = PAGEPOOL_FREE | order;
+}
+
+/* Removes the free block starting at page i from the list of the
+   order */
+static void pagepool_unlink(int i, int order)
+{
+    pagepool_block_t *block = PAGEPOOL_BLOCK(i);
+
+    if (block->prev != NULL)
+	block->prev->next = block->next;
+    else
+	pagepool_free_lists[order] = block->next;
+    if (block->next != NULL)
+	block->next->prev = block->prev;
+}
+
 /**
  * Pagepool initialization. Finds out number of physical pages and
- * number of staticly reserved physical pages. Marks reserved pages
- * reserved in pagepool_free_pages.
+ * number of staticly reserved physical pages. Puts the pages after
+ * the reserved ones to the free lists in as large blocks as their
+ * alignment allows.
  */
 void pagepool_init(void)
 {
     int num_res_pages;
-    int i;
+    int i, order;
 
     pagepool_num_pages = kmalloc_get_numpages();
 
-    pagepool_free_pages = 
-        (uint32_t *)kmalloc(bitmap_sizeof(pagepool_num_pages));
-    bitmap_init(pagepool_free_pages, pagepool_num_pages);
+    pagepool_page_state = (uint8_t *)kmalloc(pagepool_num_pages);
 
     /* Note that number of reserved pages must be get after we have 
-       (staticly) reserved memory for bitmap. */
+       (staticly) reserved memory for the page states. */
     num_res_pages = kmalloc_get_reserved_pages();
     pagepool_num_free_pages = pagepool_num_pages - num_res_pages;
     pagepool_static_end = num_res_pages;
 
-    for (i = 0; i < num_res_pages; i++)
-        bitmap_set(pagepool_free_pages, i, 1);
+    for (order = 0; order <= CONFIG_PAGEPOOL_MAX_ORDER; order++)
+	pagepool_free_lists[order] = NULL;
+
+    for (i = 0; i < pagepool_num_pages; i++)
+	pagepool_page_state[i] = PAGEPOOL_TAIL;
+
+    i = num_res_pages;
+    while (i < pagepool_num_pages) {
+	order = 0;
+	while (order < CONFIG_PAGEPOOL_MAX_ORDER
+	       && (i & (1 << order)) == 0
+	       && i + (2 << order) <= pagepool_num_pages)
+	    order++;
+	pagepool_push(i, order);
+	i += 1 << order;
+    }
 
     spinlock_reset(&pagepool_slock);
+    spinlock_stats_register(&pagepool_slock);
+
+    spinlock_reset(&pagepool_zeroed_slock);
+    spinlock_stats_register(&pagepool_zeroed_slock);
+    pagepool_zeroed_count  = 0;
+    pagepool_zeroer_sleeping = 0;
+    pagepool_zeroed_hits   = 0;
+    pagepool_zeroed_misses = 0;
+
+    for (i = 0; i < CONFIG_MAX_CPUS; i++) {
+	spinlock_reset(&pagepool_caches[i].slock);
+	spinlock_stats_register(&pagepool_caches[i].slock);
+	pagepool_caches[i].count   = 0;
+	pagepool_caches[i].hits    = 0;
+	pagepool_caches[i].refills = 0;
+	pagepool_caches[i].drains  = 0;
+    }
 
     kprintf("Pagepool: Found %d pages of size %d\n", pagepool_num_pages,
             PAGE_SIZE);
@@ -100,66 +266,460 @@ void pagepool_init(void)
 
 }
 
+/* Takes a block of the order from the free lists. Called with
+   pagepool_slock held. Returns the first page of the block, -1 if
+   no block is available. */
+static int pagepool_alloc_block(int order)
+{
+    int i, o;
+
+    for (o = order; o <= CONFIG_PAGEPOOL_MAX_ORDER; o++) {
+	if (pagepool_free_lists[o] != NULL)
+	    break;
+    }
+
+    if (o > CONFIG_PAGEPOOL_MAX_ORDER)
+	return -1;
+
+    i = PAGEPOOL_PAGE(pagepool_free_lists[o]);
+    pagepool_unlink(i, o);
+
+    /* Split the block, freeing the upper halves */
+    while (o > order) {
+	o--;
+	pagepool_push(i + (1 << o), o);
+    }
+
+    pagepool_page_state[i] = order;
+    pagepool_num_free_pages -= 1 << order;
+
+    /* Check that the pagepool internal variables are in synch. */
+    KERNEL_ASSERT(i >= pagepool_static_end 
+		  && pagepool_num_free_pages >= 0);
+
+    return i;
+}
+
+/* Returns the block starting at page i to the free lists, merging
+   it with its free buddies. Called with pagepool_slock held. */
+static void pagepool_free_block(int i, int order)
+{
+    int buddy;
+
+    /* Check that the block was reserved with this order. */
+    KERNEL_ASSERT(pagepool_page_state[i] == order);
+
+    pagepool_num_free_pages += 1 << order;
+
+    while (order < CONFIG_PAGEPOOL_MAX_ORDER) {
+	buddy = i ^ (1 << order);
+	if (buddy + (1 << order) > pagepool_num_pages
+	    || pagepool_page_state[buddy] != (PAGEPOOL_FREE | order))
+	    break;
+
+	pagepool_unlink(buddy, order);
+	pagepool_page_state[buddy] = PAGEPOOL_TAIL;
+	pagepool_page_state[i] = PAGEPOOL_TAIL;
+	if (buddy < i)
+	    i = buddy;
+	order++;
+    }
+    pagepool_push(i, order);
+}
+
+/* Takes a page from the cache of this CPU, refilling the cache from
+   the free lists if it is empty. Called with interrupts disabled.
+   Returns the page number, -1 if the cache and the free lists are
+   empty. */
+static int pagepool_cache_get(void)
+{
+    pagepool_cache_t *cache;
+    int i = -1;
+
+    cache = &pagepool_caches[_interrupt_getcpu()];
+    spinlock_acquire(&cache->slock);
+
+    if (cache->count > 0) {
+	cache->hits++;
+    } else {
+	cache->refills++;
+	spinlock_acquire(&pagepool_slock);
+	while (cache->count < PAGEPOOL_BATCH) {
+	    i = pagepool_alloc_block(0);
+	    if (i < 0)
+		break;
+	    pagepool_page_state[i] = PAGEPOOL_CACHED;
+	    cache->pages[cache->count++] = i;
+	}
+	spinlock_release(&pagepool_slock);
+    }
+
+    if (cache->count > 0) {
+	i = cache->pages[--cache->count];
+	pagepool_page_state[i] = 0;
+    }
+
+    spinlock_release(&cache->slock);
+    return i;
+}
+
+/* Wakes the zeroing thread if it sleeps and is needed. Called with
+   interrupts disabled and pagepool_zeroed_slock held. */
+static void pagepool_zeroer_wake(void)
+{
+    if (pagepool_zeroer_sleeping && PAGEPOOL_ZEROER_NEEDED()) {
+	pagepool_zeroer_sleeping = 0;
+	sleepq_wake(&pagepool_zeroer_sleeping);
+    }
+}
+
+/* Returns pages from the top of the cache to the free lists until
+   count pages are left. Called with the cache spinlock held. */
+static void pagepool_cache_drain(pagepool_cache_t *cache, int count)
+{
+    int i;
+
+    if (cache->count <= count)
+	return;
+
+    cache->drains++;
+    spinlock_acquire(&pagepool_slock);
+    while (cache->count > count) {
+	i = cache->pages[--cache->count];
+	pagepool_page_state[i] = 0;
+	pagepool_free_block(i, 0);
+    }
+    spinlock_release(&pagepool_slock);
+}
+
+/* Returns the pages in the caches of all CPUs to the free lists.
+   Called with interrupts disabled when the free lists have run out.
+   Returns the number of pages returned. */
+static int pagepool_drain_caches(void)
+{
+    int cpu, drained = 0;
+
+    for (cpu = 0; cpu < CONFIG_MAX_CPUS; cpu++) {
+	spinlock_acquire(&pagepool_caches[cpu].slock);
+	drained += pagepool_caches[cpu].count;
+	pagepool_cache_drain(&pagepool_caches[cpu], 0);
+	spinlock_release(&pagepool_caches[cpu].slock);
+    }
+
+    return drained;
+}
+
 /**
- * Finds first free physical page and marks it reserved.  
+ * Allocates a block of 2^order physically contiguous pages, aligned
+ * on the size of the block.
  *
- * @return Address of first free physical page, zero if no free pages
- * are available.
+ * @param order Order of the block, at most CONFIG_PAGEPOOL_MAX_ORDER
+ *
+ * @return Physical address of the first page of the block, zero if
+ * no such block is available.
  */
-uint32_t pagepool_get_phys_page(void)
+uint32_t pagepool_get_phys_pages(int order)
 {
     interrupt_status_t intr_status;
     int i;
 
+    KERNEL_ASSERT(order >= 0 && order <= CONFIG_PAGEPOOL_MAX_ORDER);
+
+    if (order == 0)
+	return pagepool_get_phys_page();
+
     intr_status = _interrupt_disable();
     spinlock_acquire(&pagepool_slock);
-    
-    if (pagepool_num_free_pages > 0) {
-	i = bitmap_findnset(pagepool_free_pages,pagepool_num_pages);
-	pagepool_num_free_pages--;
+    i = pagepool_alloc_block(order);
+    spinlock_release(&pagepool_slock);
 
-        /* There should have been a free page. Check that the pagepool
-           internal variables are in synch. */
-	KERNEL_ASSERT(i >= 0 && pagepool_num_free_pages >= 0);
-    } else {
-        i = 0;
+    if (i < 0 && pagepool_drain_caches() > 0) {
+	/* The drained pages may have merged into a large enough block */
+	spinlock_acquire(&pagepool_slock);
+	i = pagepool_alloc_block(order);
+	spinlock_release(&pagepool_slock);
     }
 
-    spinlock_release(&pagepool_slock);
     _interrupt_set_state(intr_status);
+
+    if (i < 0)
+	return 0;
     return i*PAGE_SIZE;
 }
 
+/**
+ * Frees a block of pages allocated with pagepool_get_phys_pages,
+ * merging it with its free buddies.
+ *
+ * @param phys_addr Physical address of the first page of the block
+ * @param order Order of the block, as given when it was allocated
+ */
+void pagepool_free_phys_pages(uint32_t phys_addr, int order)
+{
+    interrupt_status_t intr_status;
+    int i;
+
+    if (order == 0) {
+	pagepool_free_phys_page(phys_addr);
+	return;
+    }
+
+    i = phys_addr / PAGE_SIZE;
+
+    /* A page allocated by kmalloc should not be freed. */
+    KERNEL_ASSERT(i >= pagepool_static_end && i < pagepool_num_pages);
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pagepool_slock);
+    
+    pagepool_free_block(i, order);
+
+    spinlock_release(&pagepool_slock);
+
+    if (pagepool_zeroer_sleeping) {
+	spinlock_acquire(&pagepool_zeroed_slock);
+	pagepool_zeroer_wake();
+	spinlock_release(&pagepool_zeroed_slock);
+    }
+
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Returns the order of an allocated block of pages, as given to
+ * pagepool_get_phys_pages. Single pages have order zero.
+ *
+ * @param phys_addr Physical address of the first page of the block
+ *
+ * @return The order of the block
+ */
+int pagepool_get_order(uint32_t phys_addr)
+{
+    int i = phys_addr / PAGE_SIZE;
+
+    KERNEL_ASSERT(i >= pagepool_static_end && i < pagepool_num_pages);
+    KERNEL_ASSERT(pagepool_page_state[i] <= CONFIG_PAGEPOOL_MAX_ORDER);
+
+    return pagepool_page_state[i];
+}
+
+/* Takes a page from the zeroed pages. Called with interrupts
+   disabled. Returns the page number, -1 if there are none. */
+static int pagepool_take_zeroed(void)
+{
+    int i = -1;
+
+    spinlock_acquire(&pagepool_zeroed_slock);
+    if (pagepool_zeroed_count > 0)
+	i = pagepool_zeroed[--pagepool_zeroed_count];
+    spinlock_release(&pagepool_zeroed_slock);
+
+    return i;
+}
+
+/**
+ * Finds a free physical page and marks it reserved. The page is
+ * taken from the cache of the calling CPU, which is refilled from
+ * the free lists when empty.
+ *
+ * @return Address of the free physical page, zero if no free pages
+ * are available.
+ */
+uint32_t pagepool_get_phys_page(void)
+{
+    interrupt_status_t intr_status;
+    int i;
+
+    intr_status = _interrupt_disable();
+
+    i = pagepool_cache_get();
+    if (i < 0 && pagepool_drain_caches() > 0)
+	i = pagepool_cache_get();
+    if (i < 0)
+	i = pagepool_take_zeroed();
+
+    _interrupt_set_state(intr_status);
+    return MAX(i, 0)*PAGE_SIZE;
+}
+
 /**
  * Frees given page. Given page should be reserved, but not staticly
- * reserved.
+ * reserved. The page is put to the cache of the calling CPU, half of
+ * which is first drained to the free lists if it is full.
  *
  * @param phys_addr Page to be freed.
  */
 void pagepool_free_phys_page(uint32_t phys_addr)
 {
     interrupt_status_t intr_status;
+    pagepool_cache_t *cache;
     int i;
 
     i = phys_addr / PAGE_SIZE;
 
     /* A page allocated by kmalloc should not be freed. */
-    KERNEL_ASSERT(i >= pagepool_static_end);
+    KERNEL_ASSERT(i >= pagepool_static_end && i < pagepool_num_pages);
+    /* Nor a page which is already free */
+    KERNEL_ASSERT(pagepool_page_state[i] == 0);
 
     intr_status = _interrupt_disable();
-    spinlock_acquire(&pagepool_slock);
-    
-    /* Check that the page was reserved. */
-    KERNEL_ASSERT(bitmap_get(pagepool_free_pages, i) == 1);
+    cache = &pagepool_caches[_interrupt_getcpu()];
+    spinlock_acquire(&cache->slock);
 
-    bitmap_set(pagepool_free_pages, i, 0);
-    pagepool_num_free_pages++;
+    if (cache->count == CONFIG_PAGEPOOL_CACHE_SIZE)
+	pagepool_cache_drain(cache,
+			     CONFIG_PAGEPOOL_CACHE_SIZE - PAGEPOOL_BATCH);
+    pagepool_page_state[i] = PAGEPOOL_CACHED;
+    cache->pages[cache->count++] = i;
+
+    spinlock_release(&cache->slock);
+
+    /* The freed memory may let the zeroing thread continue */
+    if (pagepool_zeroer_sleeping) {
+	spinlock_acquire(&pagepool_zeroed_slock);
+	pagepool_zeroer_wake();
+	spinlock_release(&pagepool_zeroed_slock);
+    }
 
-    spinlock_release(&pagepool_slock);
     _interrupt_set_state(intr_status);
 }
 
+/**
+ * Finds a free physical page filled with zeros and marks it
+ * reserved. A page zeroed in the background is used if available,
+ * otherwise a page is allocated and zeroed here.
+ *
+ * @return Address of the zeroed physical page, zero if no free pages
+ * are available.
+ */
+uint32_t pagepool_get_zeroed_page(void)
+{
+    interrupt_status_t intr_status;
+    uint32_t phys_addr;
+    int i;
 
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pagepool_zeroed_slock);
+    if (pagepool_zeroed_count > 0) {
+	i = pagepool_zeroed[--pagepool_zeroed_count];
+	pagepool_zeroed_hits++;
+    } else {
+	i = -1;
+	pagepool_zeroed_misses++;
+    }
+    pagepool_zeroer_wake();
+    spinlock_release(&pagepool_zeroed_slock);
+    _interrupt_set_state(intr_status);
 
-/** @} */
+    if (i >= 0)
+	return i*PAGE_SIZE;
+
+    phys_addr = pagepool_get_phys_page();
+    if (phys_addr != 0)
+	memoryset((void *)ADDR_PHYS_TO_KERNEL(phys_addr), 0, PAGE_SIZE);
+
+    return phys_addr;
+}
+
+/* Puts the zeroing thread to sleep until it is needed again */
+static void pagepool_zeroer_sleep(void)
+{
+    interrupt_status_t intr_status;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pagepool_zeroed_slock);
+
+    while (!PAGEPOOL_ZEROER_NEEDED()) {
+	pagepool_zeroer_sleeping = 1;
+	sleepq_add(&pagepool_zeroer_sleeping);
+	spinlock_release(&pagepool_zeroed_slock);
+	thread_switch();
+	spinlock_acquire(&pagepool_zeroed_slock);
+    }
+
+    spinlock_release(&pagepool_zeroed_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/* The zeroing thread. Fills the zeroed pages one page at a time,
+   yielding the CPU after each so that it only runs when nothing
+   else wants to. Pages are taken only while the free lists have more
+   free pages than the zeroed pool can hold. */
+static void pagepool_zeroer(uint32_t arg)
+{
+    interrupt_status_t intr_status;
+    uint32_t phys_addr;
+    int full;
+
+    arg = arg;
+
+    for (;;) {
+	if (pagepool_zeroed_count >= CONFIG_PAGEPOOL_ZEROED_PAGES
+	    || pagepool_num_free_pages <= CONFIG_PAGEPOOL_ZEROED_PAGES) {
+	    pagepool_zeroer_sleep();
+	    continue;
+	}
+
+	phys_addr = pagepool_get_phys_page();
+	if (phys_addr == 0) {
+	    /* Out of memory after all, nothing to do */
+	    pagepool_zeroer_sleep();
+	    continue;
+	}
+	memoryset((void *)ADDR_PHYS_TO_KERNEL(phys_addr), 0, PAGE_SIZE);
+
+	intr_status = _interrupt_disable();
+	spinlock_acquire(&pagepool_zeroed_slock);
+	full = (pagepool_zeroed_count == CONFIG_PAGEPOOL_ZEROED_PAGES);
+	if (!full)
+	    pagepool_zeroed[pagepool_zeroed_count++] = phys_addr / PAGE_SIZE;
+	spinlock_release(&pagepool_zeroed_slock);
+	_interrupt_set_state(intr_status);
+
+	if (full)
+	    pagepool_free_phys_page(phys_addr);
 
+	thread_yield();
+    }
+}
+
+/**
+ * Starts the thread keeping pre-zeroed pages for
+ * pagepool_get_zeroed_page. Must be called after threading has been
+ * initialized.
+ */
+void pagepool_start_zeroer(void)
+{
+    TID_t tid;
+
+    tid = thread_create(&pagepool_zeroer, 0);
+    /* Thread creation should succeed. If not, increase the number
+       of threads in the system by editing config.h. */
+    KERNEL_ASSERT(tid >= 0);
+    thread_run(tid);
+}
+
+#if CONFIG_PAGEPOOL_STATS
+/**
+ * Prints the page cache counters of each CPU.
+ */
+void pagepool_print_stats(void)
+{
+    int i;
+
+    for (i = 0; i < CONFIG_MAX_CPUS; i++) {
+	if (pagepool_caches[i].hits == 0 && pagepool_caches[i].refills == 0)
+	    continue;
+	kprintf("Pagepool: CPU %d: cache hits %u, refills %u, drains %u\n",
+		i, pagepool_caches[i].hits, pagepool_caches[i].refills,
+		pagepool_caches[i].drains);
+    }
+    kprintf("Pagepool: %d of %d pages free in the free lists\n",
+	    pagepool_num_free_pages, pagepool_num_pages);
+    kprintf("Pagepool: zeroed pages %d, hits %u, misses %u\n",
+	    pagepool_zeroed_count, pagepool_zeroed_hits,
+	    pagepool_zeroed_misses);
+}
+#endif
+
+/** @} */
@@ -37,6 +37,7 @@
 #ifndef BUENOS_VM_PAGEPOOL_H
 #define BUENOS_VM_PAGEPOOL_H
 
+#include "kernel/config.h"
 #include "lib/libc.h"
 
 #define ADDR_PHYS_TO_KERNEL(addr) ((addr) | 0x80000000)
@@ -46,5 +47,13 @@
 void pagepool_init(void);
 uint32_t pagepool_get_phys_page(void);
 void pagepool_free_phys_page(uint32_t phys_addr);
+uint32_t pagepool_get_phys_pages(int order);
+void pagepool_free_phys_pages(uint32_t phys_addr, int order);
+int pagepool_get_order(uint32_t phys_addr);
+uint32_t pagepool_get_zeroed_page(void);
+void pagepool_start_zeroer(void);
+#if CONFIG_PAGEPOOL_STATS
+void pagepool_print_stats(void);
+#endif
 
 #endif /* BUENOS_VM_PAGEPOOL_H */
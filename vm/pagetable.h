@@ -40,18 +40,61 @@
 #include "lib/libc.h"
 #include "vm/tlb.h"
 
-/* Number of mapping entries in one pagetable. This is the number
-   of entries that fits on a single hardware memory page (4k). */
-#define PAGETABLE_ENTRIES 340
+/* A pagetable is a two-level tree indexed by the virtual page pair
+   number (VPN2, see tlb_entry_t). The directory in the pagetable_t
+   points to leaves, each of which is one page of mappings of
+   consecutive page pairs. Leaves are allocated as the address space
+   is mapped, so unmapped regions cost only a NULL directory entry. */
+
+/* Number of page pair mappings in one leaf. A leaf fills exactly one
+   hardware memory page (4k). */
+#define PAGETABLE_LEAF_BITS    9
+#define PAGETABLE_LEAF_ENTRIES (1 << PAGETABLE_LEAF_BITS)
+
+/* Number of leaves in the directory. Together the leaves cover the
+   user address space 0x00000000 - 0x7fffffff. */
+#define PAGETABLE_DIRECTORY_ENTRIES \
+    (1 << (31 - 13 - PAGETABLE_LEAF_BITS))
+
+/* Returns the directory and leaf indices of the page pair of vaddr */
+#define PAGETABLE_DIRECTORY_INDEX(vaddr) \
+    ((vaddr) >> (13 + PAGETABLE_LEAF_BITS))
+#define PAGETABLE_LEAF_INDEX(vaddr) \
+    (((vaddr) >> 13) & (PAGETABLE_LEAF_ENTRIES - 1))
+
+/* Mapping of one virtual page pair in a leaf. These are the two
+   EntryLo words of tlb_entry_t: the VPN2 is implied by the position
+   of the entry and the ASID is that of the pagetable. An entry
+   which maps neither page is all zeros. */
+typedef struct {
+    unsigned int dummy2:6   __attribute__ ((packed));
+    /* Physical page number, cache settings, dirty, valid and global
+       bits of the even page, as in tlb_entry_t */
+    unsigned int PFN0:20    __attribute__ ((packed));
+    unsigned int C0:3       __attribute__ ((packed));
+    unsigned int D0:1       __attribute__ ((packed));
+    unsigned int V0:1       __attribute__ ((packed));
+    unsigned int G0:1       __attribute__ ((packed));
+
+    unsigned int dummy3:6   __attribute__ ((packed));
+    /* The same for the odd page */
+    unsigned int PFN1:20    __attribute__ ((packed));
+    unsigned int C1:3       __attribute__ ((packed));
+    unsigned int D1:1       __attribute__ ((packed));
+    unsigned int V1:1       __attribute__ ((packed));
+    unsigned int G1:1       __attribute__ ((packed));
+} pagetable_entry_t;
 
 /* A pagetable. This structure fits on one physical page (4k). */
 typedef struct pagetable_struct_t{
-    /* Address space identifier. We use Thread Ids in Buenos. */
+    /* Address space identifier. The lowest 8 bits are the hardware
+       ASID and the rest is the generation it was allocated in, see
+       vm/asid.c. */
     uint32_t ASID;
-    /* Number of valid consecutive mappings in this pagetable. */
+    /* Number of valid page mappings in this pagetable. */
     uint32_t valid_count;
-    /* Actual virtual memory mapping entries*/
-    tlb_entry_t entries[PAGETABLE_ENTRIES];
+    /* Leaves of the pagetable, NULL where nothing is mapped */
+    pagetable_entry_t *leaves[PAGETABLE_DIRECTORY_ENTRIES];
 } pagetable_t;
 
 #endif /* BUENOS_VM_PAGETABLE_H */
@@ -38,7 +38,16 @@
 #include "kernel/assert.h"
 #include "vm/tlb.h"
 #include "vm/pagetable.h"
+#include "vm/vm.h"
+#include "vm/asid.h"
 #include "kernel/thread.h"
+#include "kernel/config.h"
+
+/* Pagetable of the thread running on each CPU, NULL for kernel
+   threads. Set by asid_activate and read by the TLB refill handler
+   _tlb_refill in vm/_tlb.S, which handles most TLB misses without
+   entering C code. */
+struct pagetable_struct_t *tlb_current_pagetable[CONFIG_MAX_CPUS];
 
 void tlb_modified_exception(void)
 {  
@@ -55,20 +64,110 @@ void tlb_store_exception(void)
   tlb_seek_insert();
 }
 
+/* Builds the TLB entry of the given page pair from its pagetable
+   entry, for the given hardware ASID. On a miss this is the ASID in
+   EntryHi at the time of the fault, which is what _tlb_refill uses
+   too. The ASID of the pagetable may have been replaced since then,
+   and an entry with it would not match the faulting access. */
+static void tlb_make_entry(tlb_entry_t *entry, uint32_t asid,
+                           uint32_t vpn2, pagetable_entry_t *pair)
+{
+  memoryset(entry, 0, sizeof(tlb_entry_t));
+  entry->VPN2 = vpn2;
+  entry->ASID = asid;
+  entry->PFN0 = pair->PFN0;
+  entry->D0   = pair->D0;
+  entry->V0   = pair->V0;
+  entry->G0   = pair->G0;
+  entry->PFN1 = pair->PFN1;
+  entry->D1   = pair->D1;
+  entry->V1   = pair->V1;
+  entry->G1   = pair->G1;
+}
+
+/* Called for the TLB misses _tlb_refill could not handle and for
+   accesses to invalid pages in the TLB. The pair is reloaded if the
+   page has been mapped since it was put in the TLB. The TLB row of
+   the pair is overwritten if there is one, since two rows matching
+   the same address are not allowed. */
 void tlb_seek_insert(void)
 {
   tlb_exception_state_t state;
+  tlb_entry_t entry;
+  pagetable_entry_t *pair;
+  int index;
   _tlb_get_exception_state(&state);
   pagetable_t *table = thread_get_current_thread_entry()->pagetable;
-  for (int i = 0; i < (int)table->valid_count; i++) {
-    if (table->entries[i].VPN2 == state.badvpn2) {
-      _tlb_write_random(&table->entries[i]);
+  if (table != NULL) {
+    pair = vm_lookup(table, state.badvaddr);
+    if (pair != NULL && ((state.badvaddr & 0x1000) ? pair->V1 : pair->V0)) {
+      tlb_make_entry(&entry, state.asid, state.badvpn2, pair);
+      index = _tlb_probe(&entry);
+      if (index >= 0)
+        _tlb_write(&entry, index, 1);
+      else
+        _tlb_write_random(&entry);
       return;
     }
   }
   KERNEL_PANIC("Access violation");
 }
 
+/**
+ * Invalidates all entries in the TLB of this CPU. Each row is
+ * overwritten with an invalid mapping of a distinct page in the
+ * unmapped kernel segment, so that no two rows match the same
+ * address. Interrupts must be disabled.
+ */
+
+void tlb_flush(void)
+{
+    tlb_entry_t entry;
+    uint32_t i, max, asid;
+
+    asid = _tlb_get_asid();
+
+    memoryset(&entry, 0, sizeof(entry));
+    max = _tlb_get_maxindex();
+
+    for (i = 0; i <= max; i++) {
+	entry.VPN2 = (0x80000000 >> 13) + i;
+	_tlb_write(&entry, i, 1);
+    }
+
+    /* Writing the entries changed the ASID in EntryHi */
+    _tlb_set_asid(asid);
+}
+
+/**
+ * Invalidates the entries of the given address space in the TLB of
+ * this CPU. Interrupts must be disabled.
+ *
+ * @param asid Hardware ASID whose entries are invalidated
+ */
+
+void tlb_flush_asid(uint32_t asid)
+{
+    tlb_entry_t entry;
+    uint32_t i, max, current;
+
+    current = _tlb_get_asid();
+    max = _tlb_get_maxindex();
+
+    for (i = 0; i <= max; i++) {
+	_tlb_read(&entry, i, 1);
+	if (entry.ASID != asid || !(entry.V0 || entry.V1))
+	    continue;
+
+	memoryset(&entry, 0, sizeof(entry));
+	entry.VPN2 = (0x80000000 >> 13) + i;
+	_tlb_write(&entry, i, 1);
+    }
+
+    /* Reading and writing the entries changed the ASID in EntryHi */
+    _tlb_set_asid(current);
+}
+
 /**
  * Fill TLB with given pagetable. This function is used to set memory
  * mappings in CP0's TLB before we have a proper TLB handling system.
@@ -80,15 +179,32 @@ void tlb_seek_insert(void)
 
 void tlb_fill(pagetable_t *pagetable)
 {
+    tlb_entry_t entry;
+    pagetable_entry_t *leaf;
+    uint32_t i, j, index = 0;
+
     if(pagetable == NULL)
 	return;
 
-    /* Check that the pagetable can fit into TLB. This is needed until
-     we have proper VM system, because the whole pagetable must fit
-     into TLB. */
-    KERNEL_ASSERT(pagetable->valid_count <= (_tlb_get_maxindex()+1));
+    for (i = 0; i < PAGETABLE_DIRECTORY_ENTRIES; i++) {
+	leaf = pagetable->leaves[i];
+	if (leaf == NULL)
+	    continue;
 
-    _tlb_write(pagetable->entries, 0, pagetable->valid_count);
+	for (j = 0; j < PAGETABLE_LEAF_ENTRIES; j++) {
+	    if (!(leaf[j].V0 || leaf[j].V1))
+		continue;
+
+	    /* Check that the pagetable can fit into TLB. This is
+	       needed until we have proper VM system, because the
+	       whole pagetable must fit into TLB. */
+	    KERNEL_ASSERT(index <= _tlb_get_maxindex());
+
+	    tlb_make_entry(&entry, ASID_HW(pagetable->ASID),
+			   (i << PAGETABLE_LEAF_BITS) | j, &leaf[j]);
+	    _tlb_write(&entry, index++, 1);
+	}
+    }
 
     /* Set ASID field in Co-Processor 0 to match thread ID so that
        only entries with the ASID of the current thread will match in
@@ -50,7 +50,7 @@ typedef struct {
     unsigned int VPN2:19    __attribute__ ((packed));
     unsigned int dummy1:5   __attribute__ ((packed));
     /* Address space identifier. When ASID matches CP0 setted ASID
-       this entry is valid. In Buenos, we use mapping ASID = Thread Id. */
+       this entry is valid. ASIDs are handed out by vm/asid.c. */
     unsigned int ASID:8     __attribute__ ((packed));
 
     unsigned int dummy2:6   __attribute__ ((packed));
@@ -95,14 +95,23 @@ void tlb_modified_exception(void);
 void tlb_load_exception(void);
 void tlb_store_exception(void);
 void tlb_seek_insert(void);
+void tlb_flush(void);
+void tlb_flush_asid(uint32_t asid);
 
 /* Forward declare pagetable_t (== struct pagetable_struct_t) */
 struct pagetable_struct_t;
 void tlb_fill(struct pagetable_struct_t *pagetable);
 
+/* Pagetable of the thread running on each CPU, for _tlb_refill */
+extern struct pagetable_struct_t *tlb_current_pagetable[];
+
+/* TLB refill exception vector code, see vm/_tlb.S */
+void _tlb_refill_vector_code(void);
+
 /* assembler function wrappers */
 void _tlb_get_exception_state(tlb_exception_state_t *state);
 void _tlb_set_asid(uint32_t asid);
+uint32_t _tlb_get_asid(void);
 uint32_t _tlb_get_maxindex(void);
 
 int _tlb_probe(tlb_entry_t *entry);
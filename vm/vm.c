@@ -37,6 +37,7 @@
 #include "vm/pagetable.h"
 #include "vm/vm.h"
 #include "vm/pagepool.h"
+#include "vm/asid.h"
 #include "kernel/kmalloc.h"
 #include "kernel/assert.h"
 
@@ -57,7 +58,7 @@
 /**
  * Initializes virtual memory system. Initialization consists of page
  * pool initialization and disabling static memory reservation. After
- * this kmalloc() may not be used anymore.
+ * this kmalloc() allocates freeable memory from the slab allocator.
  */ 
 void vm_init(void)
 {
@@ -67,27 +68,35 @@ void vm_init(void)
        Any extensions to pagetables should also provide this information
        in this form. */
     KERNEL_ASSERT(sizeof(tlb_entry_t) == 12);
+    /* Likewise the leaf entries of pagetables must be the two
+       EntryLo registers, and the pagetable must fit in a page. */
+    KERNEL_ASSERT(sizeof(pagetable_entry_t) == 8);
+    KERNEL_ASSERT(sizeof(pagetable_t) <= PAGE_SIZE);
+    /* _tlb_refill in vm/_tlb.S finds the leaves at this offset */
+    KERNEL_ASSERT((uint32_t)&((pagetable_t *)0)->leaves == 8);
 
     pagepool_init();
+    asid_init();
     kmalloc_disable();
 }
 
 /**
- *  Creates a new page table. Reserves memory (one page) for the table
- *  and sets the address space identifier for the created page table.
- *
- *  @param asid Address space identifier
+ *  Creates a new page table. Reserves memory (one page) for the
+ *  table directory. Leaves are allocated as they are needed by
+ *  vm_map. The address space identifier is allocated when the table
+ *  is first activated (see asid_activate).
  *
  *  @return The created page table
  *
  */
 
-pagetable_t *vm_create_pagetable(uint32_t asid)
+pagetable_t *vm_create_pagetable(void)
 {
     pagetable_t *table;
     uint32_t addr;
 
-    addr = pagepool_get_phys_page();
+    /* A zeroed page has all the leaf pointers NULL */
+    addr = pagepool_get_zeroed_page();
     if(addr == 0) {
 	return NULL;
     }
@@ -98,15 +107,16 @@ pagetable_t *vm_create_pagetable(uint32_t asid)
        physical memory. */
     table = (pagetable_t *) (ADDR_PHYS_TO_KERNEL(addr));
 
-    table->ASID        = asid;
+    table->ASID        = 0;
     table->valid_count = 0;
 
     return table;
 }
 
 /**
- * Destroys given pagetable. Frees the memory (one page) allocated for
- * the pagetable. Does not remove mappings from the TLB.
+ * Destroys given pagetable. Frees the memory allocated for the
+ * pagetable directory and its leaves. Does not free the mapped pages
+ * or remove mappings from the TLB.
  *
  * @param pagetable Page table to destroy
  *
@@ -114,9 +124,42 @@ pagetable_t *vm_create_pagetable(uint32_t asid)
 
 void vm_destroy_pagetable(pagetable_t *pagetable)
 {
+    int i;
+
+    for (i = 0; i < PAGETABLE_DIRECTORY_ENTRIES; i++) {
+	if (pagetable->leaves[i] != NULL)
+	    pagepool_free_phys_page(
+		ADDR_KERNEL_TO_PHYS((uint32_t)pagetable->leaves[i]));
+    }
+
     pagepool_free_phys_page(ADDR_KERNEL_TO_PHYS((uint32_t) pagetable));
 }
 
+/**
+ * Finds the mapping entry of the page pair containing the given
+ * virtual address.
+ *
+ * @param pagetable Page table to look in
+ *
+ * @param vaddr Virtual address in the user address space
+ *
+ * @return The entry, NULL if no leaf covers vaddr.
+ */
+
+pagetable_entry_t *vm_lookup(pagetable_t *pagetable, uint32_t vaddr)
+{
+    pagetable_entry_t *leaf;
+
+    if (vaddr >= 0x80000000)
+	return NULL;
+
+    leaf = pagetable->leaves[PAGETABLE_DIRECTORY_INDEX(vaddr)];
+    if (leaf == NULL)
+	return NULL;
+
+    return &leaf[PAGETABLE_LEAF_INDEX(vaddr)];
+}
+
 /**
  * Maps given virtual address to given physical address in given page
  * table. Does not modify TLB. The mapping is done in 4k chunks (pages).
@@ -133,78 +176,56 @@ void vm_destroy_pagetable(pagetable_t *pagetable)
  * page is not dirty (write-protected). The terminology comes
  * from hardware, in reality, this is write enabling bit.
  *
+ * @return 0 on success, -1 if no page could be allocated for the
+ * pagetable, in which case nothing is mapped.
  */
 
-void vm_map(pagetable_t *pagetable, 
+int vm_map(pagetable_t *pagetable, 
 	    uint32_t physaddr, 
 	    uint32_t vaddr,
             int dirty)
 {
-    unsigned int i;
+    pagetable_entry_t *entry;
+    uint32_t addr;
 
     KERNEL_ASSERT(dirty == 0 || dirty == 1);
+    KERNEL_ASSERT(vaddr < 0x80000000);
 
-    for(i=0; i<pagetable->valid_count; i++) {
-	if(pagetable->entries[i].VPN2 == (vaddr >> 13)) {
-	    /* TLB has separate mappings for even and odd 
-	       virtual pages. Let's handle them separately here,
-	       and we have much more fun when updating the TLB later.*/
-	    if(ADDR_IS_ON_EVEN_PAGE(vaddr)) {
-		if(pagetable->entries[i].V0 == 1) {
-		    KERNEL_PANIC("Tried to re-map same virtual page");
-		} else {
-		    /* Map the page on a pair entry */
-		    pagetable->entries[i].PFN0 = physaddr >> 12;
-		    pagetable->entries[i].V0 = 1;
-		    pagetable->entries[i].G0 = 0;
-		    pagetable->entries[i].D0 = dirty;
-		    return;
-		}
-	    } else {
-		if(pagetable->entries[i].V1 == 1) {
-		    KERNEL_PANIC("Tried to re-map same virtual page");
-		} else {
-		    /* Map the page on a pair entry */
-		    pagetable->entries[i].PFN1 = physaddr >> 12;
-		    pagetable->entries[i].V1 = 1;
-		    pagetable->entries[i].G1 = 0;
-		    pagetable->entries[i].D1 = dirty;
-		    return;
-		}
-	    }
-	}
-    }
-    /* No previous or pairing mapping was found */
-
-    /* Make sure that pagetable is not full */
-    if(pagetable->valid_count >= PAGETABLE_ENTRIES) {
-	kprintf("Thread with ASID=%d run out of pagetable mapping entries\n",
-		pagetable->ASID);
-	kprintf("during an attempt to map vaddr 0x%8.8x => phys 0x%8.8x.\n",
-		vaddr, physaddr);
-	KERNEL_PANIC("Thread run out of pagetable mapping entries.");
-    }
-
-    /* Map the page on a new entry */
+    entry = vm_lookup(pagetable, vaddr);
+    if (entry == NULL) {
+	/* Allocate the leaf. A zeroed leaf maps nothing. */
+	addr = pagepool_get_zeroed_page();
+	if (addr == 0)
+	    return -1;
 
-    pagetable->entries[pagetable->valid_count].VPN2 = vaddr >> 13;
-    pagetable->entries[pagetable->valid_count].ASID = pagetable->ASID;
+	pagetable->leaves[PAGETABLE_DIRECTORY_INDEX(vaddr)] =
+	    (pagetable_entry_t *)ADDR_PHYS_TO_KERNEL(addr);
+	entry = vm_lookup(pagetable, vaddr);
+    }
 
+    /* TLB has separate mappings for even and odd virtual pages.
+       Let's handle them separately here, and we have much more fun
+       when updating the TLB later.*/
     if(ADDR_IS_ON_EVEN_PAGE(vaddr)) {
-	pagetable->entries[pagetable->valid_count].PFN0 = physaddr >> 12;
-	pagetable->entries[pagetable->valid_count].D0   = dirty;
-	pagetable->entries[pagetable->valid_count].V0   = 1;
-	pagetable->entries[pagetable->valid_count].G0   = 0;
-	pagetable->entries[pagetable->valid_count].V1   = 0;
+	if(entry->V0 == 1)
+	    KERNEL_PANIC("Tried to re-map same virtual page");
+
+	entry->PFN0 = physaddr >> 12;
+	entry->D0   = dirty;
+	entry->G0   = 0;
+	entry->V0   = 1;
     } else {
-	pagetable->entries[pagetable->valid_count].PFN1 = physaddr >> 12;
-	pagetable->entries[pagetable->valid_count].D1   = dirty;
-	pagetable->entries[pagetable->valid_count].V1   = 1;
-	pagetable->entries[pagetable->valid_count].G1   = 0;
-	pagetable->entries[pagetable->valid_count].V0   = 0;
+	if(entry->V1 == 1)
+	    KERNEL_PANIC("Tried to re-map same virtual page");
+
+	entry->PFN1 = physaddr >> 12;
+	entry->D1   = dirty;
+	entry->G1   = 0;
+	entry->V1   = 1;
     }
 
     pagetable->valid_count++;
+    return 0;
 }
 
 /**
@@ -238,35 +259,50 @@ void vm_unmap(pagetable_t *pagetable, uint32_t vaddr)
  */
 void vm_set_dirty(pagetable_t *pagetable, uint32_t vaddr, int dirty)
 {
-    unsigned int i;
+    pagetable_entry_t *entry;
 
     KERNEL_ASSERT(dirty == 0 || dirty == 1);
 
-    for(i=0; i<pagetable->valid_count; i++) {
-	if(pagetable->entries[i].VPN2 == (vaddr >> 13)) {
-            /* Check whether this is an even or odd page */
-	    if(ADDR_IS_ON_EVEN_PAGE(vaddr)) {
-		if(pagetable->entries[i].V0 == 0) {
-		    KERNEL_PANIC("Tried to set dirty bit of an unmapped "
-                                 "entry");
-		} else {
-		    pagetable->entries[i].D0 = dirty;
-		    return;
-		}
-	    } else {
-		if(pagetable->entries[i].V1 == 0) {
-		    KERNEL_PANIC("Tried to set dirty bit of an unmapped "
-                                 "entry");
-		} else {
-		    pagetable->entries[i].D1 = dirty;
-		    return;
-		}
-	    }
-	}
+    entry = vm_lookup(pagetable, vaddr);
+
+    /* Check whether this is an even or odd page */
+    if(entry != NULL && ADDR_IS_ON_EVEN_PAGE(vaddr) && entry->V0 == 1) {
+	entry->D0 = dirty;
+    } else if(entry != NULL && ADDR_IS_ON_ODD_PAGE(vaddr) 
+	      && entry->V1 == 1) {
+	entry->D1 = dirty;
+    } else {
+	KERNEL_PANIC("Tried to set dirty bit of an unmapped entry");
+    }
+}
+
+/**
+ * Translates the given virtual address to a physical address using
+ * the mappings in the given pagetable. Does not look at the TLB.
+ *
+ * @param pagetable The pagetable to use for the translation
+ *
+ * @param vaddr The virtual address to translate
+ *
+ * @return The physical address, or 0 if vaddr is not mapped
+ */
+uint32_t vm_translate(pagetable_t *pagetable, uint32_t vaddr)
+{
+    pagetable_entry_t *entry;
+
+    entry = vm_lookup(pagetable, vaddr);
+    if (entry == NULL)
+	return 0;
+
+    if(ADDR_IS_ON_EVEN_PAGE(vaddr)) {
+	if(entry->V0 == 1)
+	    return (entry->PFN0 << 12) | (vaddr & (PAGE_SIZE - 1));
+    } else {
+	if(entry->V1 == 1)
+	    return (entry->PFN1 << 12) | (vaddr & (PAGE_SIZE - 1));
     }
-    /* No mapping was found */
 
-    KERNEL_PANIC("Tried to set dirty bit of an unmapped entry");
+    return 0;
 }
 
 /** @} */